@@ -18,16 +18,28 @@
  */
 
 #include "AbstractSocket.h"
+#include <pwnat/Application.h>
+#include <pwnat/metrics/Counter.h>
+#include <pwnat/Watchdog.h>
 #include <boost/log/trivial.hpp>
 
 #include <pwnat/namespaces.h>
 
-AbstractSocket::AbstractSocket(bool connected, DeathHandler death_handler, string name) :
+static Counter send_buffer_bytes("pwnat_send_buffer_bytes", "Bytes queued in the send buffers of sockets", Counter::GAUGE);
+static Counter receive_buffer_bytes("pwnat_receive_buffer_bytes", "Bytes waiting in the receive buffers of sockets", Counter::GAUGE);
+
+AbstractSocket::AbstractSocket(bool connected, asio::io_service::strand strand, DeathHandler death_handler, string name) :
+    m_strand(strand),
     m_name(name),
     m_connected(connected),
+    m_receiving_paused(false),
+    m_data_source(nullptr),
     m_death_handler(death_handler),
+    m_lifetime(make_shared<int>(0)),
     m_connected_handler([](){}),
-    m_received_data_handler([](asio::streambuf&){})
+    m_received_data_handler([](ChunkBuffer&){}),
+    m_reported_send_buffer_size(0),
+    m_reported_receive_buffer_size(0)
 {
 }
 
@@ -37,11 +49,19 @@ AbstractSocket::~AbstractSocket() {
 }
 
 bool AbstractSocket::dispose() {
+    m_pending_death_handler = DeathHandler();  // our owner is disposing us, it need not hear of our death
     if (Disposable::dispose()) {
         // unset all handlers (there might be shared_ptr in them)
         m_death_handler = DeathHandler();
         m_connected_handler = ConnectedHandler();
         m_received_data_handler = ReceivedDataHandler();
+        m_drained_handler = DrainedHandler();
+        m_data_source = nullptr;
+
+        send_buffer_bytes.add(-static_cast<int64_t>(m_reported_send_buffer_size.load(memory_order_relaxed)));
+        receive_buffer_bytes.add(-static_cast<int64_t>(m_reported_receive_buffer_size.load(memory_order_relaxed)));
+        m_reported_send_buffer_size.store(0, memory_order_relaxed);
+        m_reported_receive_buffer_size.store(0, memory_order_relaxed);
         return true;
     }
     else {
@@ -60,19 +80,19 @@ void AbstractSocket::init() {
 void AbstractSocket::send(const char* data, size_t length) {
     if (disposed()) return;
 
-    ostream ostr(&m_send_buffer);
-    ostr.write(data, length);
+    m_send_buffer.append(data, length);
+    update_flow_control();
+
     if (connected()) {
         start_sending();
     }
 }
 
-void AbstractSocket::send(asio::streambuf& buffer) {
+void AbstractSocket::send(ChunkBuffer& buffer) {
     if (disposed()) return;
 
-    ostream ostr(&m_send_buffer);
-    ostr.write(asio::buffer_cast<const char*>(buffer.data()), buffer.size());
-    buffer.consume(buffer.size());
+    m_send_buffer.append(buffer);
+    update_flow_control();
 
     if (connected()) {
         start_sending();
@@ -102,8 +122,111 @@ bool AbstractSocket::connected() {
     return m_connected;
 }
 
+void AbstractSocket::on_death(DeathHandler handler) {
+    if (disposed()) {
+        if (m_pending_death_handler) {
+            m_pending_death_handler = handler;  // died but not yet handled
+        }
+        return;
+    }
+    m_death_handler = handler;
+}
+
+void AbstractSocket::on_drained(DrainedHandler handler) {
+    if (disposed()) return;
+    m_drained_handler = handler;
+}
+
+size_t AbstractSocket::send_buffer_size() {
+    return m_send_buffer.size();
+}
+
+size_t AbstractSocket::reported_send_buffer_size() {
+    return m_reported_send_buffer_size.load(memory_order_relaxed);
+}
+
+size_t AbstractSocket::reported_receive_buffer_size() {
+    return m_reported_receive_buffer_size.load(memory_order_relaxed);
+}
+
+void AbstractSocket::pause_receiving() {
+    if (disposed()) return;
+    if (!m_receiving_paused) {
+        BOOST_LOG_TRIVIAL(trace) << m_name << ": pausing receive" << endl;
+        m_receiving_paused = true;
+    }
+}
+
+void AbstractSocket::resume_receiving() {
+    if (disposed()) return;
+    if (m_receiving_paused) {
+        BOOST_LOG_TRIVIAL(trace) << m_name << ": resuming receive" << endl;
+        m_receiving_paused = false;
+        if (connected()) {
+            start_receiving();
+
+            // redeliver what the listener left while paused, the peer may not send anything more
+            if (!disposed() && !m_receiving_paused && m_receive_buffer.size()) {
+                notify_received_data();
+            }
+        }
+    }
+}
+
+bool AbstractSocket::receiving_paused() {
+    return m_receiving_paused;
+}
+
+void AbstractSocket::set_data_source(AbstractSocket& socket) {
+    m_data_source = &socket;
+}
+
+void AbstractSocket::clear_data_source() {
+    m_data_source = nullptr;
+}
+
+void AbstractSocket::update_flow_control() {
+    update_buffer_metrics();
+    if (!m_data_source && !m_drained_handler) return;
+
+    auto& args = Application::instance().args();
+    if (m_send_buffer.size() >= args.send_buffer_high_watermark()) {
+        if (m_data_source) {
+            m_data_source->pause_receiving();
+        }
+    }
+    else if (m_send_buffer.size() <= args.send_buffer_low_watermark()) {
+        if (m_data_source) {
+            m_data_source->resume_receiving();
+        }
+        if (m_drained_handler) {
+            m_drained_handler();
+        }
+    }
+}
+
 void AbstractSocket::notify_received_data() {
     m_received_data_handler(m_receive_buffer);
+    update_buffer_metrics();
+}
+
+void AbstractSocket::update_buffer_metrics() {
+    if (disposed()) return;
+
+    // Note: usually only one of the buffers changed, skip the other
+    size_t send_size = m_send_buffer.size();
+    size_t reported_send_size = m_reported_send_buffer_size.load(memory_order_relaxed);
+    if (send_size != reported_send_size) {
+        send_buffer_bytes.add(static_cast<int64_t>(send_size) - static_cast<int64_t>(reported_send_size));
+        m_reported_send_buffer_size.store(send_size, memory_order_relaxed);
+    }
+
+    size_t receive_size = m_receive_buffer.size();
+    size_t reported_receive_size = m_reported_receive_buffer_size.load(memory_order_relaxed);
+    if (receive_size != reported_receive_size) {
+        receive_buffer_bytes.add(static_cast<int64_t>(receive_size) - static_cast<int64_t>(reported_receive_size));
+        m_reported_receive_buffer_size.store(receive_size, memory_order_relaxed);
+    }
 }
 
 void AbstractSocket::notify_connected() {
@@ -116,12 +239,40 @@ void AbstractSocket::notify_connected() {
 }
 
 void AbstractSocket::die(const string& reason) {
-    m_death_handler();
+    if (disposed()) return;
+
+    BOOST_LOG_TRIVIAL(error) << m_name << " died: " << reason << endl;
+    auto death_handler = m_death_handler;
     dispose();
+    m_pending_death_handler = death_handler;
 
-    stringstream str;
-    str << m_name << " died: " << reason << endl;
-    throw SocketException(str.str());
+    weak_ptr<int> lifetime = m_lifetime;
+    m_strand.post(Watchdog::watch([this, lifetime]() {
+        if (!lifetime.expired()) {
+            handle_death();
+        }
+    }));
+}
+
+void AbstractSocket::kill(const string& reason) {
+    die(reason);
+}
+
+void AbstractSocket::handle_death() {
+    if (!m_pending_death_handler) return;
+
+    auto death_handler = m_pending_death_handler;
+    m_pending_death_handler = DeathHandler();
+    death_handler();
+}
+
+void AbstractSocket::close(const string& reason) {
+    if (disposed()) return;
+
+    BOOST_LOG_TRIVIAL(debug) << m_name << " closed: " << reason << endl;
+    auto death_handler = m_death_handler;
+    dispose();
+    death_handler();  // Note: last, it may delete us
 }
 
 void AbstractSocket::die(const string& prefix, const boost::system::error_code& error) {
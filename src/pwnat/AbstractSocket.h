@@ -21,7 +21,9 @@
 
 #include <boost/asio.hpp>
 #include <pwnat/Disposable.h>
-#include "SocketException.h"
+#include <atomic>
+#include <memory>
+#include <pwnat/ChunkBuffer.h>
 
 /**
  * Abstract connection-oriented socket
@@ -29,6 +31,9 @@
  * Sending and receiving can be done before the socket is connected, (though it
  * still has to be initialized first)
  *
+ * All completion handlers of a socket run in the strand it's given, the strand
+ * of the tunnel it's part of.
+ *
  * Note on using Disposable pattern + shared_ptr (which the derived classes
  * use): Event notifications may still come in after the object is supposed to
  * be dead. Until then it has to stay alive and not respond to those
@@ -39,16 +44,17 @@ public:
     /**
      * receive_buffer: whatever you don't consume will be included in a next call
      */
-    typedef std::function<void(boost::asio::streambuf& receive_buffer)> ReceivedDataHandler;
+    typedef std::function<void(ChunkBuffer& receive_buffer)> ReceivedDataHandler;
 
     typedef std::function<void()> ConnectedHandler;
     typedef std::function<void()> DeathHandler;
+    typedef std::function<void()> DrainedHandler;
 
 public:
-    AbstractSocket(bool connected, DeathHandler death_handler, std::string name);
+    AbstractSocket(bool connected, boost::asio::io_service::strand strand, DeathHandler death_handler, std::string name);
     virtual ~AbstractSocket();
 
-    bool dispose();
+    virtual bool dispose();
 
     /**
      * Must be called before any other methods
@@ -70,9 +76,9 @@ public:
     void send(const char* data, size_t length);
 
     /**
-     * Consumes buffer and asynchronously sends it
+     * Takes over the contents of buffer and asynchronously sends it
      */
-    void send(boost::asio::streambuf& buffer);
+    void send(ChunkBuffer& buffer);
 
     /**
      * Set handler that's called when socket received some data
@@ -90,16 +96,61 @@ public:
 
     bool connected();
 
+    /**
+     * Replace the handler that's called when the socket dies
+     */
+    void on_death(DeathHandler);
+
+    /**
+     * Set handler that's called whenever the send buffer is at or below the low watermark after it changed
+     */
+    void on_drained(DrainedHandler);
+
+    size_t send_buffer_size();
+
+    /**
+     * Size of the send/receive buffer as last added to the buffer metrics
+     *
+     * Thread safe, unlike send_buffer_size.
+     */
+    size_t reported_send_buffer_size();
+    size_t reported_receive_buffer_size();
+
     /**
      * Using on_receive, from now on send whatever the given socket receives
+     *
+     * While our send buffer is above the high watermark, the given socket
+     * stops receiving, until the buffer drains to the low watermark.
      */
     virtual void receive_data_from(AbstractSocket& socket) = 0;
 
+    /**
+     * Stop receiving until resume_receiving is called
+     *
+     * On resume, data left in the receive buffer is handed to the listener again.
+     */
+    void pause_receiving();
+    void resume_receiving();
+
+    /**
+     * Die, e.g. because the peer violated the protocol carried over the socket
+     */
+    void kill(const std::string& reason);
+
+    /**
+     * Stop pausing/resuming the socket given to receive_data_from
+     *
+     * Call when handing this socket over to a new owner, whose sockets
+     * may outlive the data source.
+     */
+    void clear_data_source();
+
 protected:
     /**
      * Asynchronously wait for messages
      *
-     * May end up being called while already receiving.
+     * May end up being called while already receiving. Should stop waiting for
+     * messages while receiving_paused().
      */
     virtual void start_receiving() = 0;
 
@@ -115,7 +166,7 @@ protected:
     /**
      * Notify listener of received data
      */
-    void notify_received_data();
+    virtual void notify_received_data();
 
     /**
      * Notify listener that socket is connected
@@ -123,22 +174,61 @@ protected:
     void notify_connected();
 
     /**
-     * Dispose us and call DeathHandler
+     * Dispose us and call DeathHandler from a later handler in our strand
+     *
+     * Deferring the DeathHandler keeps our owner alive until the calling
+     * handler returns; the caller should return right after.
      */
     void die(const std::string& reason);
 
     void die(const std::string& prefix, const boost::system::error_code& error);
 
+    /**
+     * Dispose us and call DeathHandler right away, for an expected end of the connection
+     *
+     * Unlike die, the DeathHandler isn't deferred and the reason is logged at
+     * debug rather than error level.
+     */
+    void close(const std::string& reason);
+
+    bool receiving_paused();
+
+    /**
+     * Set socket whose data we send, see receive_data_from
+     */
+    void set_data_source(AbstractSocket& socket);
+
+    /**
+     * Pause/resume data source according to send buffer watermarks
+     *
+     * Call whenever the size of the send buffer changed.
+     */
+    void update_flow_control();
+
+private:
+    void update_buffer_metrics();
+    void handle_death();
+
 protected:
-    boost::asio::streambuf m_receive_buffer;
-    boost::asio::streambuf m_send_buffer;
+    ChunkBuffer m_receive_buffer;
+    ChunkBuffer m_send_buffer;
+    boost::asio::io_service::strand m_strand;
 
     std::string m_name; // TODO might want to make private and provide a function to print error/info
 
 private:
     bool m_connected;
+    bool m_receiving_paused;
+    AbstractSocket* m_data_source; // Note: owner of the sockets disposes both together, so this doesn't dangle
     DeathHandler m_death_handler;
+    DeathHandler m_pending_death_handler; // set while a died socket waits for handle_death, unset by dispose
+    std::shared_ptr<int> m_lifetime; // expires on deallocation, for deferred handlers
 
     ConnectedHandler m_connected_handler;
     ReceivedDataHandler m_received_data_handler;
+    DrainedHandler m_drained_handler;
+
+    // buffer sizes last added to the buffer metrics, only written in our strand
+    std::atomic<size_t> m_reported_send_buffer_size;
+    std::atomic<size_t> m_reported_receive_buffer_size;
 };
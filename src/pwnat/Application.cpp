@@ -20,7 +20,7 @@
 #include "Application.h"
 #include <udt/udt.h>
 #include <csignal>
-#include <pwnat/SocketException.h>
+#include <boost/thread.hpp>
 #include <pwnat/util.h>
 #include <boost/log/core.hpp>
 #include <boost/log/expressions.hpp>
@@ -31,7 +31,9 @@
 Application* Application::m_instance = nullptr;
 
 Application::Application(const ProgramArgs& args) :
-    m_udt_service(m_io_service),
+    m_udt_services(m_io_service, args.udt_threads(), args.watchdog_interval() ? args.stall_threshold() : 0),
+    m_resolver(m_io_service),
+    m_udt_performance(m_io_service, args.udt_stats_interval()),
     m_args(args)
 {
     assert(!m_instance); // singleton
@@ -66,20 +68,35 @@ Application::Application(const ProgramArgs& args) :
     if (UDT::startup() == UDT::ERROR) {
         throw runtime_error(format_udt_error("UDT startup failed"));
     }
+
+    if (args.metrics_port()) {
+        m_metrics_server.reset(new MetricsServer(m_io_service, args.metrics_port()));
+    }
+
+    if (args.watchdog_interval()) {
+        m_watchdog.reset(new Watchdog(m_io_service, args.watchdog_interval(), args.stall_threshold()));
+    }
 }
 
 void Application::run() {
-    BOOST_LOG_TRIVIAL(debug) << "Running" << endl;
-    while (!m_io_service.stopped()) {
-        try {
-            m_io_service.run();
-        }
-        catch (const SocketException& e) {
-            BOOST_LOG_TRIVIAL(error) << e.what() << endl;
-        }
+    BOOST_LOG_TRIVIAL(debug) << "Running with " << m_args.io_threads() << " io threads" << endl;
+
+    boost::thread_group threads;
+    for (size_t i = 1; i < m_args.io_threads(); ++i) {
+        threads.create_thread(bind(&Application::run_io_service, this));
     }
+    run_io_service();
+    threads.join_all();
 
-    m_udt_service.stop();
+    m_udt_services.stop();
+}
+
+void Application::run_io_service() {
+    if (m_watchdog) {
+        m_watchdog->add_thread();
+    }
+
+    m_io_service.run();
 }
 
 void Application::signal_handler(int sig)
@@ -99,3 +116,11 @@ const ProgramArgs& Application::args() {
     return m_args;
 }
 
+CachingResolver& Application::resolver() {
+    return m_resolver;
+}
+
+UDTPerfMonitor& Application::udt_performance() {
+    return m_udt_performance;
+}
+
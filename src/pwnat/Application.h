@@ -21,10 +21,17 @@
 
 #include <boost/asio.hpp>
 #include <pwnat/ProgramArgs.h>
-#include <pwnat/udtservice/UDTService.h>
+#include <pwnat/udtservice/UDTServicePool.h>
+#include <pwnat/CachingResolver.h>
+#include <pwnat/udtservice/UDTPerfMonitor.h>
+#include <pwnat/metrics/MetricsServer.h>
+#include <pwnat/Watchdog.h>
 
 /**
  * Singleton application
+ *
+ * The io_service is run by multiple threads, handlers that share state must be
+ * wrapped in a strand. Each tunnel has its own strand.
  */
 class Application {
 public:
@@ -35,12 +42,24 @@ public:
     void run();
     const ProgramArgs& args();
 
+    /**
+     * Resolver shared by all of the application
+     */
+    CachingResolver& resolver();
+
+    UDTPerfMonitor& udt_performance();
+
 private:
     static void signal_handler(int sig);
+    void run_io_service();
 
 protected:
     boost::asio::io_service m_io_service;
-    UDTService m_udt_service;
+    UDTServicePool m_udt_services;
+    CachingResolver m_resolver;
+    UDTPerfMonitor m_udt_performance;
+    std::unique_ptr<MetricsServer> m_metrics_server; // null if not serving metrics
+    std::unique_ptr<Watchdog> m_watchdog; // null if not watching for stalls
 
 private:
     static Application* m_instance;
@@ -0,0 +1,157 @@
+/*
+ * Copyright (C) 2013 by Tim Diels
+ *
+ * This file is part of pwnat.
+ *
+ * pwnat is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * pwnat is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with pwnat.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "CachingResolver.h"
+#include <boost/bind.hpp>
+#include <boost/log/trivial.hpp>
+
+#include <pwnat/namespaces.h>
+
+using boost::posix_time::ptime;
+using boost::posix_time::seconds;
+using boost::posix_time::microsec_clock;
+
+const long CachingResolver::ttl_seconds;
+const long CachingResolver::negative_ttl_seconds;
+const long CachingResolver::refresh_seconds;
+const size_t CachingResolver::max_entries;
+const size_t CachingResolver::query_thread_count;
+
+CachingResolver::Entry::Entry() :
+    resolving(false)
+{
+}
+
+CachingResolver::CachingResolver(asio::io_service& io_service, Lookup lookup) :
+    m_io_service(io_service),
+    m_lookup(lookup ? lookup : &CachingResolver::lookup_host),
+    m_query_work(m_query_service),
+    m_entries(max_entries)
+{
+    for (size_t i = 0; i < query_thread_count; i++) {
+        m_query_threads.create_thread(bind(&asio::io_service::run, &m_query_service));
+    }
+}
+
+CachingResolver::~CachingResolver() {
+    m_query_service.stop();  // Note: waits for queries in progress
+    m_query_threads.join_all();
+}
+
+void CachingResolver::async_resolve(const string& host, ResolveHandler handler) {
+    boost::lock_guard<boost::mutex> guard(m_lock);
+    auto now = microsec_clock::universal_time();
+    auto& entry = m_entries[host];
+
+    if (!entry.expiry_time.is_not_a_date_time() && now < entry.expiry_time) {
+        if (!entry.resolving && !entry.error && entry.expiry_time - now < seconds(refresh_seconds)) {
+            start_query(host, entry);  // refresh in the background
+        }
+        m_io_service.post(bind(handler, entry.error, entry.addresses));
+    }
+    else {
+        entry.handlers.push_back(handler);
+        if (!entry.resolving) {
+            start_query(host, entry);
+        }
+    }
+    evict();
+}
+
+CachingResolver::Addresses CachingResolver::resolve(const string& host) {
+    {
+        boost::lock_guard<boost::mutex> guard(m_lock);
+        auto entry = m_entries.find(host);
+        if (entry && !entry->expiry_time.is_not_a_date_time() && microsec_clock::universal_time() < entry->expiry_time) {
+            if (entry->error) {
+                throw boost::system::system_error(entry->error);
+            }
+            return entry->addresses;
+        }
+    }
+
+    BOOST_LOG_TRIVIAL(debug) << "Resolving " << host << endl;
+    boost::system::error_code error;
+    auto addresses = m_lookup(host, error);
+
+    vector<ResolveHandler> handlers;
+    store(host, error, addresses, handlers);
+    for (auto& handler : handlers) {
+        m_io_service.post(bind(handler, error, addresses));
+    }
+
+    if (error) {
+        throw boost::system::system_error(error);
+    }
+    return addresses;
+}
+
+void CachingResolver::start_query(const string& host, Entry& entry) {
+    BOOST_LOG_TRIVIAL(debug) << "Resolving " << host << endl;
+    entry.resolving = true;
+    m_query_service.post(bind(&CachingResolver::run_query, this, host));
+}
+
+void CachingResolver::run_query(string host) {
+    boost::system::error_code error;
+    auto addresses = m_lookup(host, error);
+
+    vector<ResolveHandler> handlers;
+    store(host, error, addresses, handlers);
+    for (auto& handler : handlers) {
+        m_io_service.post(bind(handler, error, addresses));
+    }
+}
+
+void CachingResolver::store(const string& host, const boost::system::error_code& error, const Addresses& addresses, vector<ResolveHandler>& handlers) {
+    boost::lock_guard<boost::mutex> guard(m_lock);
+    auto now = microsec_clock::universal_time();
+    auto& entry = m_entries[host];
+    entry.resolving = false;
+    handlers.swap(entry.handlers);
+
+    bool is_valid = !entry.expiry_time.is_not_a_date_time() && now < entry.expiry_time;
+    if (error && is_valid && !entry.error) {
+        BOOST_LOG_TRIVIAL(warning) << "Warning: failed to refresh " << host << ": " << error.message() << endl;
+        return;  // keep the addresses we have until they expire
+    }
+
+    entry.error = error;
+    entry.addresses = addresses;
+    entry.expiry_time = now + seconds(error ? negative_ttl_seconds : ttl_seconds);
+    evict();
+}
+
+void CachingResolver::evict() {
+    // Note: handlers wait on entries that are being resolved
+    m_entries.evict([](const Entry& entry) { return entry.resolving; });
+}
+
+CachingResolver::Addresses CachingResolver::lookup_host(const string& host, boost::system::error_code& error) {
+    asio::io_service io_service;
+    asio::ip::tcp::resolver resolver(io_service);
+    asio::ip::tcp::resolver::query query(host, "0");
+    auto result = resolver.resolve(query, error);
+
+    Addresses addresses;
+    for (; result != asio::ip::tcp::resolver::iterator(); ++result) {
+        addresses.push_back(result->endpoint().address());
+    }
+    return addresses;
+}
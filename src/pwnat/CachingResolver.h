@@ -0,0 +1,114 @@
+/*
+ * Copyright (C) 2013 by Tim Diels
+ *
+ * This file is part of pwnat.
+ *
+ * pwnat is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * pwnat is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with pwnat.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <functional>
+#include <string>
+#include <vector>
+#include <boost/asio.hpp>
+#include <boost/thread.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
+#include <pwnat/LruMap.h>
+
+/**
+ * Resolves host names to addresses, caching results. Thread safe
+ *
+ * Concurrent lookups of the same name share one query. Failed lookups are
+ * cached as well, shortly. Names that are looked up while their entry is about
+ * to expire are refreshed in the background, so callers don't wait for them.
+ *
+ * getaddrinfo doesn't tell the TTL of records, so entries live for a fixed time.
+ * Host names come from clients, so the number of entries is capped, the least
+ * recently used are evicted. Queries run on a few threads of the resolver,
+ * so a name whose lookup times out doesn't hold up the lookups of others.
+ */
+class CachingResolver {
+public:
+    static const long ttl_seconds = 60;
+    static const long negative_ttl_seconds = 5;
+    static const long refresh_seconds = 10; // refresh entries that are used within this time of expiring
+    static const size_t max_entries = 4096; // entries being resolved are never evicted, so may exceed this
+    static const size_t query_thread_count = 4; // max concurrent queries
+
+    typedef std::vector<boost::asio::ip::address> Addresses;
+
+    /**
+     * Called with the addresses of the host, which are never empty on success
+     */
+    typedef std::function<void(boost::system::error_code, const Addresses&)> ResolveHandler;
+
+    /**
+     * Look up host, blocking. Sets error if it can't be resolved
+     */
+    typedef std::function<Addresses(const std::string& host, boost::system::error_code& error)> Lookup;
+
+public:
+    /**
+     * lookup: if not set, uses getaddrinfo
+     */
+    CachingResolver(boost::asio::io_service&, Lookup lookup = Lookup());
+    ~CachingResolver();
+
+    /**
+     * Resolve host, handler is called from the io_service
+     */
+    void async_resolve(const std::string& host, ResolveHandler handler);
+
+    /**
+     * Resolve host, blocking until resolved
+     *
+     * Throws boost::system::system_error if host can't be resolved.
+     */
+    Addresses resolve(const std::string& host);
+
+private:
+    struct Entry {
+        Entry();
+
+        boost::system::error_code error;
+        Addresses addresses;
+        boost::posix_time::ptime expiry_time; // not_a_date_time if never resolved
+        bool resolving;
+        std::vector<ResolveHandler> handlers; // waiting for the query to complete
+    };
+
+private:
+    // Note: m_lock must be held
+    void start_query(const std::string& host, Entry& entry);
+
+    void run_query(std::string host);
+    void store(const std::string& host, const boost::system::error_code& error, const Addresses& addresses, std::vector<ResolveHandler>& handlers);
+
+    // Note: m_lock must be held
+    void evict();
+
+    static Addresses lookup_host(const std::string& host, boost::system::error_code& error);
+
+private:
+    boost::asio::io_service& m_io_service;
+    const Lookup m_lookup;
+
+    boost::asio::io_service m_query_service; // runs queries on m_query_threads
+    boost::asio::io_service::work m_query_work;
+    boost::thread_group m_query_threads;
+
+    boost::mutex m_lock; // guards the members below
+    LruMap<std::string, Entry> m_entries;
+};
@@ -0,0 +1,154 @@
+/*
+ * Copyright (C) 2013 by Tim Diels
+ *
+ * This file is part of pwnat.
+ *
+ * pwnat is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * pwnat is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with pwnat.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "ChunkBuffer.h"
+#include <cassert>
+#include <cstring>
+#include <algorithm>
+
+#include <pwnat/namespaces.h>
+
+const size_t ChunkBuffer::chunk_size;
+
+ChunkBuffer::ChunkBuffer() :
+    m_size(0),
+    m_write_offset(0),
+    m_prepared_size(0)
+{
+}
+
+asio::mutable_buffers_1 ChunkBuffer::prepare(size_t size) {
+    assert(size > 0);
+
+    // Reuse the tail of the current chunk, unless it's too small to bother
+    const size_t min_tail_size = 4 * 1024;
+    size_t available = m_write_chunk ? m_write_chunk->size() - m_write_offset : 0;
+    if (available < min(size, min_tail_size)) {
+        m_write_chunk = make_shared<vector<char>>(max(size, chunk_size));
+        m_write_offset = 0;
+        available = m_write_chunk->size();
+    }
+
+    m_prepared_size = min(size, available);
+    return asio::buffer(m_write_chunk->data() + m_write_offset, m_prepared_size);
+}
+
+void ChunkBuffer::commit(size_t size) {
+    assert(size <= m_prepared_size);
+    m_prepared_size = 0;
+    if (size == 0) return;
+
+    if (!m_slices.empty() && m_slices.back().chunk == m_write_chunk && m_slices.back().end == m_write_offset) {
+        m_slices.back().end += size;
+    }
+    else {
+        Slice slice = {m_write_chunk, m_write_offset, m_write_offset + size};
+        m_slices.push_back(slice);
+    }
+
+    m_write_offset += size;
+    m_size += size;
+}
+
+void ChunkBuffer::append(const char* data, size_t length) {
+    while (length > 0) {
+        auto buffer = prepare(length);
+        size_t size = asio::buffer_size(buffer);
+        memcpy(asio::buffer_cast<char*>(buffer), data, size);
+        commit(size);
+        data += size;
+        length -= size;
+    }
+}
+
+void ChunkBuffer::append(ChunkBuffer& buffer) {
+    if (&buffer == this) return;
+
+    move(buffer.m_slices.begin(), buffer.m_slices.end(), back_inserter(m_slices));
+    m_size += buffer.m_size;
+
+    buffer.m_slices.clear();
+    buffer.m_size = 0;
+}
+
+void ChunkBuffer::append(ChunkBuffer& buffer, size_t size) {
+    if (&buffer == this) return;
+
+    size = min(size, buffer.m_size);
+    m_size += size;
+    buffer.m_size -= size;
+
+    while (size > 0) {
+        auto& slice = buffer.m_slices.front();
+        size_t slice_size = slice.end - slice.begin;
+        if (size < slice_size) {
+            Slice head = {slice.chunk, slice.begin, slice.begin + size};
+            m_slices.push_back(head);
+            slice.begin += size;
+            break;
+        }
+        else {
+            m_slices.push_back(move(slice));
+            buffer.m_slices.pop_front();
+            size -= slice_size;
+        }
+    }
+}
+
+void ChunkBuffer::consume(size_t size) {
+    size = min(size, m_size);
+    m_size -= size;
+
+    while (size > 0) {
+        auto& slice = m_slices.front();
+        size_t slice_size = slice.end - slice.begin;
+        if (size < slice_size) {
+            slice.begin += size;
+            break;
+        }
+        else {
+            size -= slice_size;
+            m_slices.pop_front();
+        }
+    }
+}
+
+size_t ChunkBuffer::size() const {
+    return m_size;
+}
+
+vector<asio::const_buffer> ChunkBuffer::data() const {
+    vector<asio::const_buffer> buffers;
+    buffers.reserve(m_slices.size());
+    for (auto& slice : m_slices) {
+        buffers.push_back(asio::buffer(slice.chunk->data() + slice.begin, slice.end - slice.begin));
+    }
+    return buffers;
+}
+
+size_t ChunkBuffer::copy(char* destination, size_t size) const {
+    size_t copied = 0;
+    for (auto& slice : m_slices) {
+        if (copied == size) break;
+        size_t length = min(size - copied, slice.end - slice.begin);
+        memcpy(destination + copied, slice.chunk->data() + slice.begin, length);
+        copied += length;
+    }
+    return copied;
+}
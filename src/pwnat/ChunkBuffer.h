@@ -0,0 +1,110 @@
+/*
+ * Copyright (C) 2013 by Tim Diels
+ *
+ * This file is part of pwnat.
+ *
+ * pwnat is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * pwnat is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with pwnat.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <deque>
+#include <memory>
+#include <vector>
+#include <boost/asio.hpp>
+
+/**
+ * Byte queue made of a chain of refcounted chunks
+ *
+ * Data is received directly into a chunk (prepare/commit), handed to another
+ * buffer by moving the chunk references (append(ChunkBuffer&)), and sent from
+ * there with gather I/O (data()). Relayed bytes are never copied.
+ *
+ * Chunks are shared between buffers: consumed/committed regions of a chunk are
+ * never written to again, so slices of one chunk can safely live in different
+ * buffers.
+ */
+class ChunkBuffer {
+public:
+    static const size_t chunk_size = 64 * 1024;
+
+public:
+    ChunkBuffer();
+
+    /**
+     * Get writable space of at most size bytes at the end of the buffer
+     *
+     * Returned buffer may be smaller than size, but is never empty. Space is
+     * valid until the next call to prepare or commit.
+     */
+    boost::asio::mutable_buffers_1 prepare(size_t size);
+
+    /**
+     * Append size bytes of the prepared space to the buffer
+     */
+    void commit(size_t size);
+
+    /**
+     * Append a copy of data
+     */
+    void append(const char* data, size_t length);
+
+    /**
+     * Move all data of buffer to the end of this buffer, without copying
+     */
+    void append(ChunkBuffer& buffer);
+
+    /**
+     * Move the first size bytes of buffer to the end of this buffer, without copying
+     */
+    void append(ChunkBuffer& buffer, size_t size);
+
+    /**
+     * Remove size bytes from the front of the buffer
+     */
+    void consume(size_t size);
+
+    size_t size() const;
+
+    /**
+     * Get buffer sequence of the data in the buffer, for gather I/O
+     *
+     * Valid until the buffer is modified.
+     */
+    std::vector<boost::asio::const_buffer> data() const;
+
+    /**
+     * Copy at most size bytes from the front of the buffer to destination
+     *
+     * Returns number of bytes copied
+     */
+    size_t copy(char* destination, size_t size) const;
+
+private:
+    typedef std::shared_ptr<std::vector<char>> Chunk;
+
+    struct Slice {
+        Chunk chunk;
+        size_t begin;
+        size_t end;
+    };
+
+private:
+    std::deque<Slice> m_slices;
+    size_t m_size;
+
+    Chunk m_write_chunk;  // chunk prepare() hands out space of
+    size_t m_write_offset;  // start of unused space in m_write_chunk
+    size_t m_prepared_size;
+};
@@ -29,7 +29,6 @@ public:
      */
     bool dispose();
 
-protected:
     bool disposed();
 
 private:
@@ -0,0 +1,54 @@
+/*
+ * Copyright (C) 2013 by Tim Diels
+ *
+ * This file is part of pwnat.
+ *
+ * pwnat is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * pwnat is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with pwnat.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "EndpointCache.h"
+
+#include <pwnat/namespaces.h>
+
+using boost::posix_time::seconds;
+using boost::posix_time::microsec_clock;
+
+const long EndpointCache::ttl_seconds;
+const size_t EndpointCache::max_entries;
+
+EndpointCache::EndpointCache() :
+    m_entries(max_entries)
+{
+}
+
+void EndpointCache::set(const string& host, const asio::ip::tcp::endpoint& endpoint) {
+    boost::lock_guard<boost::mutex> guard(m_lock);
+    auto& entry = m_entries[host];
+    entry.endpoint = endpoint;
+    entry.expiry_time = microsec_clock::universal_time() + seconds(ttl_seconds);
+    m_entries.evict();
+}
+
+asio::ip::tcp::endpoint EndpointCache::get(const string& host) {
+    boost::lock_guard<boost::mutex> guard(m_lock);
+    auto entry = m_entries.find(host);
+    if (!entry) {
+        return asio::ip::tcp::endpoint();
+    }
+    if (entry->expiry_time <= microsec_clock::universal_time()) {
+        m_entries.erase(host);
+        return asio::ip::tcp::endpoint();
+    }
+    return entry->endpoint;
+}
@@ -0,0 +1,59 @@
+/*
+ * Copyright (C) 2013 by Tim Diels
+ *
+ * This file is part of pwnat.
+ *
+ * pwnat is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * pwnat is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with pwnat.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <string>
+#include <boost/asio.hpp>
+#include <boost/thread.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
+#include <pwnat/LruMap.h>
+
+/**
+ * Remembers which endpoint of a host last accepted a connection. Thread safe
+ *
+ * Used to try the endpoint (and thus address family) that worked before
+ * first, see HappyEyeballs. Host names come from clients, so entries expire
+ * and their number is capped, evicting the least recently used.
+ */
+class EndpointCache {
+public:
+    static const long ttl_seconds = 600;
+    static const size_t max_entries = 4096;
+
+public:
+    EndpointCache();
+
+    void set(const std::string& host, const boost::asio::ip::tcp::endpoint&);
+
+    /**
+     * Get the endpoint that last won for host, or a default endpoint if none
+     */
+    boost::asio::ip::tcp::endpoint get(const std::string& host);
+
+private:
+    struct Entry {
+        boost::asio::ip::tcp::endpoint endpoint;
+        boost::posix_time::ptime expiry_time;
+    };
+
+private:
+    boost::mutex m_lock;
+    LruMap<std::string, Entry> m_entries;
+};
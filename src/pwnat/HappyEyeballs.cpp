@@ -0,0 +1,117 @@
+/*
+ * Copyright (C) 2013 by Tim Diels
+ *
+ * This file is part of pwnat.
+ *
+ * pwnat is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * pwnat is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with pwnat.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "HappyEyeballs.h"
+#include <algorithm>
+#include <pwnat/Watchdog.h>
+#include <boost/bind.hpp>
+
+#include <pwnat/namespaces.h>
+
+using asio::ip::tcp;
+
+const long HappyEyeballs::attempt_delay_ms;
+
+HappyEyeballs::HappyEyeballs(asio::io_service& io_service, asio::io_service::strand strand, vector<tcp::endpoint> endpoints, tcp::endpoint preferred, ConnectHandler handler) :
+    m_io_service(io_service),
+    m_strand(strand),
+    m_next_endpoint(0),
+    m_timer(io_service),
+    m_timer_generation(0),
+    m_last_error(asio::error::host_not_found),
+    m_handler(handler)
+{
+    // preferred endpoint first, then alternate families starting with that of the first endpoint
+    auto it = find(endpoints.begin(), endpoints.end(), preferred);
+    if (it != endpoints.end()) {
+        rotate(endpoints.begin(), it, it + 1);
+    }
+
+    vector<tcp::endpoint> first_family, other_family;
+    for (auto& endpoint : endpoints) {
+        bool same_family = endpoint.address().is_v6() == endpoints.front().address().is_v6();
+        (same_family ? first_family : other_family).push_back(endpoint);
+    }
+    for (size_t i = 0; i < max(first_family.size(), other_family.size()); i++) {
+        if (i < first_family.size()) m_endpoints.push_back(first_family.at(i));
+        if (i < other_family.size()) m_endpoints.push_back(other_family.at(i));
+    }
+}
+
+void HappyEyeballs::start() {
+    start_attempt();
+}
+
+void HappyEyeballs::cancel() {
+    m_handler = ConnectHandler();
+    m_timer.cancel();
+    m_timer_generation++;  // Note: the expiry may already be queued, cancel can't stop it
+    for (auto& socket : m_attempts) {
+        boost::system::error_code error;
+        socket->close(error);
+    }
+    m_attempts.clear();
+}
+
+void HappyEyeballs::start_attempt() {
+    if (!m_handler) return;
+
+    if (m_next_endpoint == m_endpoints.size()) {
+        if (m_attempts.empty()) {
+            finish(m_last_error, nullptr);
+        }
+        return;
+    }
+
+    auto socket = make_shared<tcp::socket>(m_io_service);
+    m_attempts.push_back(socket);
+    auto callback = bind(&HappyEyeballs::handle_connected, shared_from_this(), asio::placeholders::error, socket);
+    socket->async_connect(m_endpoints.at(m_next_endpoint++), m_strand.wrap(Watchdog::watch(callback)));
+
+    // Note: re-arming doesn't stop an expiry that's already queued, its generation makes it stale
+    m_timer_generation++;
+    m_timer.expires_from_now(boost::posix_time::milliseconds(attempt_delay_ms));
+    m_timer.async_wait(m_strand.wrap(Watchdog::watch(bind(&HappyEyeballs::handle_timer_expired, shared_from_this(), m_timer_generation, asio::placeholders::error))));
+}
+
+void HappyEyeballs::handle_connected(boost::system::error_code error, shared_ptr<tcp::socket> socket) {
+    if (!m_handler) return;
+
+    m_attempts.erase(remove(m_attempts.begin(), m_attempts.end(), socket), m_attempts.end());
+    if (error) {
+        m_last_error = error;
+        start_attempt();  // Note: restarts the attempt delay
+    }
+    else {
+        finish(error, socket);
+    }
+}
+
+void HappyEyeballs::handle_timer_expired(u_int64_t generation, const boost::system::error_code& error) {
+    if (error || generation != m_timer_generation) {
+        return;  // cancelled or re-armed
+    }
+    start_attempt();
+}
+
+void HappyEyeballs::finish(boost::system::error_code error, shared_ptr<tcp::socket> socket) {
+    auto handler = m_handler;
+    cancel();
+    handler(error, socket);
+}
@@ -0,0 +1,76 @@
+/*
+ * Copyright (C) 2013 by Tim Diels
+ *
+ * This file is part of pwnat.
+ *
+ * pwnat is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * pwnat is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with pwnat.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <functional>
+#include <memory>
+#include <vector>
+#include <boost/asio.hpp>
+
+/**
+ * Connects to the first of several endpoints that accepts (RFC 8305)
+ *
+ * Connection attempts are started one at a time in order, alternating between
+ * address families, starting with the preferred endpoint. The next attempt is
+ * started when the previous one fails or hasn't succeeded within the attempt
+ * delay, without cancelling it. The first attempt to succeed wins, the others
+ * are closed.
+ *
+ * All its handlers run in the given strand, its methods must be called in it.
+ */
+class HappyEyeballs : public std::enable_shared_from_this<HappyEyeballs> {
+public:
+    static const long attempt_delay_ms = 250;
+
+    /**
+     * Called with the connected socket, or with the error of the last failed attempt
+     */
+    typedef std::function<void(boost::system::error_code, std::shared_ptr<boost::asio::ip::tcp::socket>)> ConnectHandler;
+
+public:
+    /**
+     * preferred: endpoint to try first, if among endpoints
+     */
+    HappyEyeballs(boost::asio::io_service&, boost::asio::io_service::strand, std::vector<boost::asio::ip::tcp::endpoint> endpoints, boost::asio::ip::tcp::endpoint preferred, ConnectHandler);
+
+    void start();
+
+    /**
+     * Close all attempts, the handler won't be called
+     */
+    void cancel();
+
+private:
+    void start_attempt();
+    void handle_connected(boost::system::error_code error, std::shared_ptr<boost::asio::ip::tcp::socket> socket);
+    void handle_timer_expired(u_int64_t generation, const boost::system::error_code& error);
+    void finish(boost::system::error_code error, std::shared_ptr<boost::asio::ip::tcp::socket> socket);
+
+private:
+    boost::asio::io_service& m_io_service;
+    boost::asio::io_service::strand m_strand;
+    std::vector<boost::asio::ip::tcp::endpoint> m_endpoints; // in order of attempt
+    size_t m_next_endpoint;
+    std::vector<std::shared_ptr<boost::asio::ip::tcp::socket>> m_attempts; // in progress
+    boost::asio::deadline_timer m_timer;
+    u_int64_t m_timer_generation; // of the attempt delay, an expiry of an older one is stale
+    boost::system::error_code m_last_error;
+    ConnectHandler m_handler; // empty when finished
+};
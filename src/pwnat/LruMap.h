@@ -0,0 +1,107 @@
+/*
+ * Copyright (C) 2013 by Tim Diels
+ *
+ * This file is part of pwnat.
+ *
+ * pwnat is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * pwnat is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with pwnat.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <list>
+#include <unordered_map>
+#include <utility>
+
+/**
+ * Map that holds at most a fixed number of entries, evicting the least recently used
+ *
+ * References to values stay valid until their entry is erased or evicted.
+ * Not thread safe.
+ */
+template <typename Key, typename Value>
+class LruMap {
+public:
+    LruMap(size_t capacity) :
+        m_capacity(capacity)
+    {
+    }
+
+    /**
+     * Get value of key, marking it as most recently used. Returns nullptr if absent
+     */
+    Value* find(const Key& key) {
+        auto it = m_index.find(key);
+        if (it == m_index.end()) {
+            return nullptr;
+        }
+        m_entries.splice(m_entries.begin(), m_entries, it->second);
+        return &it->second->second;
+    }
+
+    /**
+     * Get value of key, inserting a default value if absent, marking it as most recently used
+     *
+     * Does not evict, call evict after an insert.
+     */
+    Value& operator[](const Key& key) {
+        auto value = find(key);
+        if (value) {
+            return *value;
+        }
+        m_entries.emplace_front(key, Value());
+        m_index[key] = m_entries.begin();
+        return m_entries.front().second;
+    }
+
+    void erase(const Key& key) {
+        auto it = m_index.find(key);
+        if (it != m_index.end()) {
+            m_entries.erase(it->second);
+            m_index.erase(it);
+        }
+    }
+
+    /**
+     * Evict least recently used entries until no more than capacity remain
+     *
+     * pinned(const Value&): entries for which it returns true are not evicted,
+     * so size may remain above capacity.
+     */
+    template <typename Predicate>
+    void evict(Predicate pinned) {
+        auto it = m_entries.end();
+        while (m_entries.size() > m_capacity && it != m_entries.begin()) {
+            --it;
+            if (!pinned(it->second)) {
+                m_index.erase(it->first);
+                it = m_entries.erase(it);
+            }
+        }
+    }
+
+    void evict() {
+        evict([](const Value&) { return false; });
+    }
+
+    size_t size() const {
+        return m_entries.size();
+    }
+
+private:
+    typedef std::list<std::pair<Key, Value>> List;
+
+    List m_entries; // most recently used first
+    std::unordered_map<Key, typename List::iterator> m_index;
+    const size_t m_capacity;
+};
@@ -0,0 +1,49 @@
+/*
+ * Copyright (C) 2013 by Tim Diels
+ *
+ * This file is part of pwnat.
+ *
+ * pwnat is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * pwnat is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with pwnat.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "ProbeSchedule.h"
+#include <algorithm>
+#include <random>
+#include <pwnat/Application.h>
+
+#include <pwnat/namespaces.h>
+
+ProbeSchedule::ProbeSchedule() {
+    auto& args = Application::instance().args();
+    m_burst_size = args.probe_burst_size();
+    m_burst_interval = args.probe_burst_interval();
+    m_initial_interval = args.probe_initial_interval();
+    m_max_interval = args.probe_max_interval();
+    m_jitter = args.probe_jitter();
+}
+
+long ProbeSchedule::get_delay(size_t probes_sent) const {
+    double delay;
+    if (probes_sent < m_burst_size) {
+        delay = m_burst_interval;
+    }
+    else {
+        size_t backoffs = min(probes_sent - m_burst_size, static_cast<size_t>(32));
+        delay = min(static_cast<double>(m_initial_interval) * (1ull << backoffs), static_cast<double>(m_max_interval));
+    }
+
+    static thread_local mt19937 random_engine(random_device{}());
+    uniform_real_distribution<double> jitter(1.0 - m_jitter, 1.0 + m_jitter);
+    return static_cast<long>(delay * jitter(random_engine));
+}
@@ -0,0 +1,50 @@
+/*
+ * Copyright (C) 2013 by Tim Diels
+ *
+ * This file is part of pwnat.
+ *
+ * pwnat is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * pwnat is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with pwnat.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <cstddef>
+
+/**
+ * When to send the next ICMP probe of a hole punching attempt
+ *
+ * A fast burst of probes first, to make up for a lost first probe quickly,
+ * then exponential backoff up to a maximum interval. Each interval gets some
+ * random jitter so that probes of many flows don't line up.
+ *
+ * Configured by the --probe* options.
+ */
+class ProbeSchedule {
+public:
+    ProbeSchedule();
+
+    /**
+     * Get milliseconds to wait between sending probe number probes_sent and the next one
+     *
+     * Thread safe.
+     */
+    long get_delay(size_t probes_sent) const;
+
+private:
+    size_t m_burst_size;
+    long m_burst_interval;
+    long m_initial_interval;
+    long m_max_interval;
+    double m_jitter;
+};
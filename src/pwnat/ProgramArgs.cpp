@@ -23,6 +23,7 @@
 #include <pwnat/accumulator.hpp>
 #include <pwnat/checksum.h>
 #include <pwnat/packet.h>
+#include <pwnat/CachingResolver.h>
 #include <boost/log/trivial.hpp>
 
 #include <pwnat/namespaces.h>
@@ -38,6 +39,21 @@ void ProgramArgs::parse(int argc, char *argv[]) {
         ("verbose,v", accumulator<int>(&m_verbosity)->implicit_value(1), "increase verbosity")
         ("bindaddress,b", po::value<string>(), "local IP to bind to")
         ("proxyport,p", po::value<u_int16_t>(&m_proxy_port)->default_value(2222), "proxy server port")
+        ("iothreads", po::value<size_t>(&m_io_threads)->default_value(1), "number of threads handling TCP traffic and socket events")
+        ("udtthreads", po::value<size_t>(&m_udt_threads)->default_value(1), "number of threads polling UDT sockets")
+        ("sendbufferhigh", po::value<size_t>(&m_send_buffer_high_watermark)->default_value(4 * 1024 * 1024), "pause receiving from a connection's peer when its send buffer holds this many bytes")
+        ("sendbufferlow", po::value<size_t>(&m_send_buffer_low_watermark)->default_value(1024 * 1024), "resume receiving from the peer when the send buffer has drained to this many bytes")
+        ("probeburst", po::value<size_t>(&m_probe_burst_size)->default_value(3), "number of ICMP probes sent in a fast burst before backing off")
+        ("probeburstinterval", po::value<long>(&m_probe_burst_interval)->default_value(50), "milliseconds between the probes of the burst")
+        ("probeinterval", po::value<long>(&m_probe_initial_interval)->default_value(250), "milliseconds between probes after the burst, doubled after each probe")
+        ("probemaxinterval", po::value<long>(&m_probe_max_interval)->default_value(5000), "maximum milliseconds between probes")
+        ("probejitter", po::value<double>(&m_probe_jitter)->default_value(0.2), "randomly vary probe intervals by up to this fraction")
+        ("udtstatsinterval", po::value<long>(&m_udt_stats_interval)->default_value(10), "seconds between samples of the performance statistics and traffic of UDT connections, logged at info level and on SIGUSR1, 0 to disable")
+        ("metricsport", po::value<u_int16_t>(&m_metrics_port)->default_value(0), "serve metrics in Prometheus text format over HTTP on this port of localhost, 0 to disable")
+        ("watchdoginterval", po::value<long>(&m_watchdog_interval)->default_value(0), "milliseconds between heartbeats measuring the lag of the io threads, 0 to disable")
+        ("coalescebytes", po::value<size_t>(&m_coalesce_bytes)->default_value(1456), "send data over UDT once this many bytes are buffered, when coalescing")
+        ("coalescedelay", po::value<long>(&m_coalesce_delay)->default_value(0), "coalesce small sends over UDT, sending buffered data at most this many microseconds late, 0 to disable")
+        ("stallthreshold", po::value<long>(&m_stall_threshold)->default_value(1000), "when watching, report io threads and UDT service threads that are busy for this many milliseconds")
     ;
 
     po::options_description client_specific_options("Client Options");
@@ -46,6 +62,12 @@ void ProgramArgs::parse(int argc, char *argv[]) {
         ("proxyhost", po::value<string>(&m_proxy_host_dns), "proxy host dns/ip")
         ("remotehost", po::value<string>(&m_remote_host), "remote server dns/ip, resolved on proxy server.")
         ("remoteport", po::value<u_int16_t>(&m_remote_port), "remote port")
+        ("multiplex", po::value<size_t>(&m_tunnels)->default_value(0), "carry TCP connections as streams over this many shared UDT tunnels, 0 to give each connection a UDT connection of its own")
+        ("poolmin", po::value<size_t>(&m_pool_min_size)->default_value(0), "number of UDT connections to keep connected in advance, when not multiplexing")
+        ("poolmax", po::value<size_t>(&m_pool_max_size)->default_value(0), "maximum number of UDT connections to keep connected in advance, 0 to disable the pool")
+        ("poolidle", po::value<long>(&m_pool_idle_timeout)->default_value(60), "seconds after which an unused pooled connection is closed, must be less than the server's flow init timeout of 600 seconds")
+        ("nodelay", po::bool_switch(&m_no_delay), "send data over UDT right away, overriding --coalescedelay for this tunnel")
+        ("stripes", po::value<size_t>(&m_stripes)->default_value(1), "number of parallel UDT connections to stripe each TCP connection over, when not multiplexing")
     ;
 
     po::positional_options_description positional_options; // maps positional options to regular options
@@ -71,6 +93,59 @@ void ProgramArgs::parse(int argc, char *argv[]) {
         throw runtime_error("Need to specify one of --server and --client");
     }
 
+    if (m_io_threads == 0) {
+        throw runtime_error("--iothreads must be at least 1");
+    }
+
+    if (m_udt_threads == 0) {
+        throw runtime_error("--udtthreads must be at least 1");
+    }
+
+    if (m_send_buffer_low_watermark > m_send_buffer_high_watermark) {
+        throw runtime_error("--sendbufferlow must not exceed --sendbufferhigh");
+    }
+
+    if (m_probe_burst_interval <= 0 || m_probe_initial_interval <= 0 || m_probe_max_interval <= 0) {
+        throw runtime_error("Probe intervals must be positive");
+    }
+
+    if (m_udt_stats_interval < 0) {
+        throw runtime_error("--udtstatsinterval must not be negative");
+    }
+
+    if (m_watchdog_interval < 0) {
+        throw runtime_error("--watchdoginterval must not be negative");
+    }
+
+    if (m_stall_threshold <= 0) {
+        throw runtime_error("--stallthreshold must be positive");
+    }
+
+    if (m_coalesce_delay < 0) {
+        throw runtime_error("--coalescedelay must not be negative");
+    }
+
+    if (m_probe_jitter < 0.0 || m_probe_jitter >= 1.0) {
+        throw runtime_error("--probejitter must be at least 0 and less than 1");
+    }
+
+    if (m_pool_min_size > m_pool_max_size) {
+        throw runtime_error("--poolmin must not exceed --poolmax");
+    }
+
+    if (m_pool_idle_timeout <= 0) {
+        throw runtime_error("--poolidle must be positive");
+    }
+
+    if (m_pool_idle_timeout >= udt_flow_init_timeout) {
+        // the server would close pooled connections before they're used
+        throw runtime_error("--poolidle must be less than the server's flow init timeout");
+    }
+
+    if (m_stripes == 0 || m_stripes > 0xffff) {
+        throw runtime_error("--stripes must be between 1 and 65535");
+    }
+
     if (vars.count("bindaddress")) {
         m_bind_address = asio::ip::address::from_string(vars["bindaddress"].as<string>());
     } else {
@@ -94,15 +169,15 @@ void ProgramArgs::parse(int argc, char *argv[]) {
     }
 }
 
-void ProgramArgs::resolve_proxy_host(boost::asio::io_service& io_service) {
+void ProgramArgs::resolve_proxy_host(CachingResolver& resolver) {
     assert(!m_is_server);
-    BOOST_LOG_TRIVIAL(debug) << "Resolving " << m_proxy_host_dns << endl;
-    asio::ip::udp::resolver resolver(io_service);
-
-    stringstream str;
-    str << m_proxy_port;
-    asio::ip::udp::resolver::query query(udp_version(), m_proxy_host_dns, str.str());
-    m_proxy_host = resolver.resolve(query)->endpoint().address();
+    for (auto& address : resolver.resolve(m_proxy_host_dns)) {
+        if (address.is_v6() == m_is_ipv6) {
+            m_proxy_host = address;
+            return;
+        }
+    }
+    throw runtime_error("Proxy host has no address of the IP version to use: " + m_proxy_host_dns);
 }
 
 void ProgramArgs::print_usage(po::options_description& options_spec) {
@@ -138,6 +213,90 @@ u_int16_t ProgramArgs::proxy_port() const {
     return m_proxy_port;
 }
 
+size_t ProgramArgs::io_threads() const {
+    return m_io_threads;
+}
+
+size_t ProgramArgs::udt_threads() const {
+    return m_udt_threads;
+}
+
+size_t ProgramArgs::send_buffer_high_watermark() const {
+    return m_send_buffer_high_watermark;
+}
+
+size_t ProgramArgs::send_buffer_low_watermark() const {
+    return m_send_buffer_low_watermark;
+}
+
+size_t ProgramArgs::probe_burst_size() const {
+    return m_probe_burst_size;
+}
+
+long ProgramArgs::probe_burst_interval() const {
+    return m_probe_burst_interval;
+}
+
+long ProgramArgs::probe_initial_interval() const {
+    return m_probe_initial_interval;
+}
+
+long ProgramArgs::probe_max_interval() const {
+    return m_probe_max_interval;
+}
+
+double ProgramArgs::probe_jitter() const {
+    return m_probe_jitter;
+}
+
+long ProgramArgs::udt_stats_interval() const {
+    return m_udt_stats_interval;
+}
+
+u_int16_t ProgramArgs::metrics_port() const {
+    return m_metrics_port;
+}
+
+long ProgramArgs::watchdog_interval() const {
+    return m_watchdog_interval;
+}
+
+long ProgramArgs::stall_threshold() const {
+    return m_stall_threshold;
+}
+
+size_t ProgramArgs::coalesce_bytes() const {
+    return m_coalesce_bytes;
+}
+
+long ProgramArgs::coalesce_delay() const {
+    return m_coalesce_delay;
+}
+
+size_t ProgramArgs::tunnels() const {
+    return m_tunnels;
+}
+
+size_t ProgramArgs::pool_min_size() const {
+    return m_pool_min_size;
+}
+
+size_t ProgramArgs::pool_max_size() const {
+    return m_pool_max_size;
+}
+
+long ProgramArgs::pool_idle_timeout() const {
+    return m_pool_idle_timeout;
+}
+
+size_t ProgramArgs::stripes() const {
+    return m_stripes;
+}
+
+bool ProgramArgs::no_delay() const {
+    return m_no_delay;
+}
+
 u_int16_t ProgramArgs::local_port() const {
     return m_local_port;
 }
@@ -218,7 +377,7 @@ void ProgramArgs::get_icmp_echo(vector<char>& buffer, u_int16_t id, u_int16_t se
         icmp->icmp6_type = ICMP6_ECHO_REQUEST;
         icmp->icmp6_id = htons(id);
         icmp->icmp6_seq = htons(sequence);
-        icmp->icmp6_cksum = htons(get_checksum(reinterpret_cast<u_int16_t*>(buffer.data()), buffer.size()));
+        icmp->icmp6_cksum = get_checksum(buffer.data(), buffer.size());
     }
     else {
         buffer.resize(sizeof(icmphdr), 0);
@@ -226,6 +385,6 @@ void ProgramArgs::get_icmp_echo(vector<char>& buffer, u_int16_t id, u_int16_t se
         icmp->type = ICMP_ECHO;
         icmp->un.echo.id = htons(id);
         icmp->un.echo.sequence = htons(sequence);
-        icmp->checksum = htons(get_checksum(reinterpret_cast<u_int16_t*>(buffer.data()), buffer.size()));
+        icmp->checksum = get_checksum(buffer.data(), buffer.size());
     }
 }
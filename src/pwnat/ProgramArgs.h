@@ -22,24 +22,47 @@
 #include <boost/asio.hpp>
 #include <boost/program_options.hpp>
 
+class CachingResolver;
+
 /**
  * The configuration of the program
  */
 class ProgramArgs {
 public:
     void parse(int argc, char *argv[]);
-    void resolve_proxy_host(boost::asio::io_service& io_service); // needs to be called exactly once before using proxy_host()
+    void resolve_proxy_host(CachingResolver& resolver); // needs to be called exactly once before using proxy_host()
 
     bool is_server() const;
     bool is_ipv6() const;
     int verbosity() const;
     const boost::asio::ip::address& bind_address() const;
     u_int16_t proxy_port() const;
+    size_t io_threads() const;
+    size_t udt_threads() const;
+    size_t send_buffer_high_watermark() const;
+    size_t send_buffer_low_watermark() const;
+    size_t probe_burst_size() const;
+    long probe_burst_interval() const; // in milliseconds
+    long probe_initial_interval() const; // in milliseconds
+    long probe_max_interval() const; // in milliseconds
+    double probe_jitter() const;
+    long udt_stats_interval() const; // in seconds, 0 if not sampling
+    u_int16_t metrics_port() const; // 0 if not serving metrics
+    long watchdog_interval() const; // in milliseconds, 0 if not watching for stalls
+    long stall_threshold() const; // in milliseconds
+    size_t coalesce_bytes() const;
+    long coalesce_delay() const; // in microseconds, 0 if not coalescing sends
 
     u_int16_t local_port() const;
     const boost::asio::ip::address& proxy_host() const;
     const std::string& remote_host() const;
     u_int16_t remote_port() const;
+    size_t tunnels() const; // number of multiplexed tunnels, 0 if not multiplexing
+    size_t pool_min_size() const;
+    size_t pool_max_size() const; // 0 if not pooling connections
+    long pool_idle_timeout() const; // in seconds
+    size_t stripes() const; // number of UDT connections per TCP connection, when not multiplexing
+    bool no_delay() const; // whether not to coalesce sends of the tunnel
 
     boost::asio::ip::icmp icmp_version() const;
     boost::asio::ip::udp udp_version() const;
@@ -59,11 +82,32 @@ private:
     int m_verbosity;
     boost::asio::ip::address m_bind_address;
     u_int16_t m_proxy_port;
+    size_t m_io_threads;
+    size_t m_udt_threads;
+    size_t m_send_buffer_high_watermark;
+    size_t m_send_buffer_low_watermark;
+    size_t m_probe_burst_size;
+    long m_probe_burst_interval;
+    long m_probe_initial_interval;
+    long m_probe_max_interval;
+    double m_probe_jitter;
+    long m_udt_stats_interval;
+    u_int16_t m_metrics_port;
+    long m_watchdog_interval;
+    long m_stall_threshold;
+    size_t m_coalesce_bytes;
+    long m_coalesce_delay;
 
     u_int16_t m_local_port;
     boost::asio::ip::address m_proxy_host;
     std::string m_proxy_host_dns;
     std::string m_remote_host;
     u_int16_t m_remote_port;
+    size_t m_tunnels;
+    size_t m_pool_min_size;
+    size_t m_pool_max_size;
+    long m_pool_idle_timeout;
+    size_t m_stripes;
+    bool m_no_delay;
 };
 
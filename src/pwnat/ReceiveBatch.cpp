@@ -0,0 +1,64 @@
+/*
+ * Copyright (C) 2013 by Tim Diels
+ *
+ * This file is part of pwnat.
+ *
+ * pwnat is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * pwnat is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with pwnat.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "ReceiveBatch.h"
+
+#include <pwnat/namespaces.h>
+
+ReceiveBatch::ReceiveBatch(size_t batch_size, size_t slot_size) :
+    m_slot_size(slot_size),
+    m_buffer(batch_size * slot_size),
+    m_iovecs(batch_size),
+    m_addresses(batch_size),
+    m_messages(batch_size)
+{
+    for (size_t i = 0; i < batch_size; i++) {
+        m_iovecs[i].iov_base = m_buffer.data() + i * slot_size;
+        m_iovecs[i].iov_len = slot_size;
+
+        auto& message = m_messages[i];
+        message = mmsghdr();
+        message.msg_hdr.msg_name = &m_addresses[i];
+        message.msg_hdr.msg_iov = &m_iovecs[i];
+        message.msg_hdr.msg_iovlen = 1;
+    }
+}
+
+int ReceiveBatch::receive(int socket) {
+    for (auto& message : m_messages) {
+        message.msg_hdr.msg_namelen = sizeof(sockaddr_storage);
+    }
+    return recvmmsg(socket, m_messages.data(), m_messages.size(), MSG_DONTWAIT, nullptr);
+}
+
+const char* ReceiveBatch::data(size_t i) const {
+    return m_buffer.data() + i * m_slot_size;
+}
+
+size_t ReceiveBatch::size(size_t i) const {
+    return m_messages[i].msg_len;
+}
+
+bool ReceiveBatch::truncated(size_t i) const {
+    return m_messages[i].msg_hdr.msg_flags & MSG_TRUNC;
+}
+
+const sockaddr_storage& ReceiveBatch::sender(size_t i) const {
+    return m_addresses[i];
+}
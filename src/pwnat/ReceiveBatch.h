@@ -0,0 +1,56 @@
+/*
+ * Copyright (C) 2013 by Tim Diels
+ *
+ * This file is part of pwnat.
+ *
+ * pwnat is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * pwnat is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with pwnat.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <vector>
+#include <sys/socket.h>
+
+/**
+ * Preallocated slots to receive a batch of datagrams into with one recvmmsg
+ */
+class ReceiveBatch {
+public:
+    ReceiveBatch(size_t batch_size, size_t slot_size);
+
+    /**
+     * Receive up to batch_size datagrams from socket without blocking
+     *
+     * Returns the number received, or -1 with errno set. EAGAIN means there
+     * was nothing to receive.
+     */
+    int receive(int socket);
+
+    const char* data(size_t i) const;
+    size_t size(size_t i) const;
+
+    /**
+     * Whether datagram i was larger than a slot and thus cut off
+     */
+    bool truncated(size_t i) const;
+
+    const sockaddr_storage& sender(size_t i) const;
+
+private:
+    const size_t m_slot_size;
+    std::vector<char> m_buffer;
+    std::vector<iovec> m_iovecs;
+    std::vector<sockaddr_storage> m_addresses;
+    std::vector<mmsghdr> m_messages;
+};
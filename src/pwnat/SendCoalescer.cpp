@@ -0,0 +1,81 @@
+/*
+ * Copyright (C) 2013 by Tim Diels
+ *
+ * This file is part of pwnat.
+ *
+ * pwnat is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * pwnat is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with pwnat.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "SendCoalescer.h"
+#include <pwnat/Watchdog.h>
+
+#include <pwnat/namespaces.h>
+
+SendCoalescer::SendCoalescer(asio::io_service::strand strand, size_t threshold, long delay) :
+    m_strand(strand),
+    m_timer(strand.get_io_service()),
+    m_threshold(threshold),
+    m_delay(delay),
+    m_no_delay(false),
+    m_armed(false),
+    m_deadline_passed(false),
+    m_generation(0)
+{
+}
+
+void SendCoalescer::set_no_delay(bool no_delay) {
+    m_no_delay = no_delay;
+}
+
+bool SendCoalescer::due(size_t buffered, DeadlineHandler handler) {
+    if (m_no_delay || m_delay == 0 || m_deadline_passed || buffered >= m_threshold) {
+        disarm();
+        return true;
+    }
+
+    if (!m_armed) {
+        m_armed = true;
+        m_generation++;
+        m_timer.expires_from_now(boost::posix_time::microseconds(m_delay));
+        m_timer.async_wait(m_strand.wrap(Watchdog::watch(bind(&SendCoalescer::handle_deadline, this, m_generation, handler, asio::placeholders::error))));
+    }
+    return false;
+}
+
+void SendCoalescer::expire() {
+    m_deadline_passed = true;
+}
+
+void SendCoalescer::reset() {
+    disarm();
+    m_deadline_passed = false;
+}
+
+void SendCoalescer::disarm() {
+    if (m_armed) {
+        m_armed = false;
+        m_generation++;  // Note: the completion may already be queued, cancel can't stop it
+        m_timer.cancel();
+    }
+}
+
+void SendCoalescer::handle_deadline(u_int64_t generation, DeadlineHandler handler, const boost::system::error_code& error) {
+    if (error || generation != m_generation) {
+        return;  // cancelled or stale
+    }
+
+    m_armed = false;
+    m_deadline_passed = true;
+    handler();
+}
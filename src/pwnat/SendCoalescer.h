@@ -0,0 +1,80 @@
+/*
+ * Copyright (C) 2013 by Tim Diels
+ *
+ * This file is part of pwnat.
+ *
+ * pwnat is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * pwnat is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with pwnat.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <functional>
+#include <boost/asio.hpp>
+
+/**
+ * Decides when to send buffered data, coalescing small sends
+ *
+ * Data is due once threshold bytes are buffered, or delay after the first of
+ * them was buffered, whichever comes first. With no delay, data is always due.
+ *
+ * Must be used in the strand it's given.
+ */
+class SendCoalescer {
+public:
+    typedef std::function<void()> DeadlineHandler;
+
+public:
+    /**
+     * threshold: in bytes
+     * delay: in microseconds, 0 to never coalesce
+     */
+    SendCoalescer(boost::asio::io_service::strand strand, size_t threshold, long delay);
+
+    /**
+     * Whether to send buffered data right away, without coalescing
+     */
+    void set_no_delay(bool no_delay);
+
+    /**
+     * Whether the buffered data is due to be sent
+     *
+     * If not, handler is called once the data's deadline passed, unless
+     * reset is called first. handler should keep the owner alive.
+     */
+    bool due(size_t buffered, DeadlineHandler handler);
+
+    /**
+     * Make the buffered data due, e.g. because part of it was sent already
+     */
+    void expire();
+
+    /**
+     * Forget the deadline, call when the buffer is empty
+     */
+    void reset();
+
+private:
+    void disarm();
+    void handle_deadline(u_int64_t generation, DeadlineHandler handler, const boost::system::error_code& error);
+
+private:
+    boost::asio::io_service::strand m_strand;
+    boost::asio::deadline_timer m_timer;
+    const size_t m_threshold;
+    const long m_delay;
+    bool m_no_delay;
+    bool m_armed; // whether waiting for the deadline
+    bool m_deadline_passed;
+    u_int64_t m_generation; // of the deadline, a completion of an older one is stale
+};
@@ -18,12 +18,17 @@
  */
 
 #include "Socket.h"
+#include <pwnat/metrics/Counter.h>
+#include <pwnat/Watchdog.h>
 #include <pwnat/namespaces.h>
 #include <boost/log/trivial.hpp>
 
+static Counter tcp_bytes_received("pwnat_bytes_received_total{transport=\"tcp\"}", "Bytes received from the network");
+static Counter tcp_bytes_sent("pwnat_bytes_sent_total{transport=\"tcp\"}", "Bytes sent onto the network");
+
 template<typename SocketType>
-Socket<SocketType>::Socket(shared_ptr<SocketType> socket, DeathHandler death_handler) : 
-    AbstractSocket(true, death_handler, "TCP socket"),
+Socket<SocketType>::Socket(shared_ptr<SocketType> socket, asio::io_service::strand strand, DeathHandler death_handler) : 
+    AbstractSocket(true, strand, death_handler, "TCP socket"),
     m_socket(socket),
     m_receiving(false),
     m_sending(false)
@@ -31,9 +36,11 @@ Socket<SocketType>::Socket(shared_ptr<SocketType> socket, DeathHandler death_han
 }
 
 template<typename SocketType>
-Socket<SocketType>::Socket(asio::io_service& io_service, DeathHandler death_handler) : 
-    AbstractSocket(false, death_handler, "TCP Socket"),
-    m_socket(make_shared<SocketType>(io_service))
+Socket<SocketType>::Socket(asio::io_service& io_service, asio::io_service::strand strand, DeathHandler death_handler) : 
+    AbstractSocket(false, strand, death_handler, "TCP Socket"),
+    m_socket(make_shared<SocketType>(io_service)),
+    m_receiving(false),
+    m_sending(false)
 {
 }
 
@@ -44,11 +51,22 @@ void Socket<SocketType>::connect(u_int16_t source_port, asio::ip::address destin
     assert(source_port == 0); // Note: custom source_port not supported by this class due to laziness
 
     auto callback = bind(&Socket<SocketType>::handle_connected, this->shared_from_this(), asio::placeholders::error);
-    m_socket->async_connect(asio::ip::tcp::endpoint(destination, destination_port), callback);
+    m_socket->async_connect(asio::ip::tcp::endpoint(destination, destination_port), m_strand.wrap(Watchdog::watch(callback)));
+}
+
+template<typename SocketType>
+void Socket<SocketType>::take_connected(shared_ptr<SocketType> socket) {
+    if (disposed()) return;
+    assert(!connected());
+
+    m_socket = socket;
+    notify_connected();
 }
 
 template<typename SocketType>
 void Socket<SocketType>::handle_connected(boost::system::error_code error) {
+    if (disposed()) return;
+
     if (error) {
         die("Failed to connect", error);
     }
@@ -62,15 +80,16 @@ void Socket<SocketType>::handle_connected(boost::system::error_code error) {
 template<typename SocketType>
 void Socket<SocketType>::receive_data_from(AbstractSocket& socket) {
     socket.on_received_data(bind(&Socket<SocketType>::send, this->shared_from_this(), _1));
+    set_data_source(socket);
 }
 
 template<typename SocketType>
 void Socket<SocketType>::start_receiving() {
-    if (disposed()) return;
+    if (disposed() || receiving_paused()) return;
     if (!m_receiving) {
         m_receiving = true;
         auto callback = bind(&Socket::handle_receive, this->shared_from_this(), asio::placeholders::error, asio::placeholders::bytes_transferred);
-        m_socket->async_receive(asio::buffer(m_receive_buffer.prepare(64 * 1024)), callback);
+        m_socket->async_receive(asio::buffer(m_receive_buffer.prepare(64 * 1024)), m_strand.wrap(Watchdog::watch(callback)));
     }
 }
 
@@ -80,7 +99,7 @@ void Socket<SocketType>::start_sending() {
     if (!m_sending && m_send_buffer.size() > 0) {
         m_sending = true;
         auto callback = bind(&Socket::handle_send, this->shared_from_this(), asio::placeholders::error, asio::placeholders::bytes_transferred);
-        m_socket->async_send(m_send_buffer.data(), callback);
+        m_socket->async_send(m_send_buffer.data(), m_strand.wrap(Watchdog::watch(callback)));
     }
 }
 
@@ -92,10 +111,12 @@ void Socket<SocketType>::handle_receive(const boost::system::error_code& error,
 
     if (error) {
         die("Error while receiving", error);
+        return;
     }
     else {
         BOOST_LOG_TRIVIAL(trace) << m_name << " received " << bytes_transferred << endl;
         m_receive_buffer.commit(bytes_transferred);
+        tcp_bytes_received.add(bytes_transferred);
         notify_received_data();
     }
 
@@ -110,10 +131,13 @@ void Socket<SocketType>::handle_send(const boost::system::error_code& error, siz
 
     if (error) {
         die("Error while sending", error);
+        return;
     }
     else {
         BOOST_LOG_TRIVIAL(trace) << m_name << " sent " << bytes_transferred << endl;
         m_send_buffer.consume(bytes_transferred);
+        tcp_bytes_sent.add(bytes_transferred);
+        update_flow_control();
     }
 
     start_sending();
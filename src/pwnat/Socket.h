@@ -31,14 +31,20 @@ public:
     /**
      * Construct a socket with an already connected socket
      */
-    Socket(std::shared_ptr<SocketType> socket, DeathHandler);
+    Socket(std::shared_ptr<SocketType> socket, boost::asio::io_service::strand, DeathHandler);
 
     /**
      * Construct a socket that has yet to connect
      */
-    Socket(boost::asio::io_service&, DeathHandler);
+    Socket(boost::asio::io_service&, boost::asio::io_service::strand, DeathHandler);
 
     void connect(u_int16_t source_port, boost::asio::ip::address destination, u_int16_t destination_port);
+
+    /**
+     * Use socket, connected by someone else, instead of connecting
+     */
+    void take_connected(std::shared_ptr<SocketType> socket);
+
     void receive_data_from(AbstractSocket& socket);
 
 protected:
@@ -0,0 +1,213 @@
+/*
+ * Copyright (C) 2013 by Tim Diels
+ *
+ * This file is part of pwnat.
+ *
+ * pwnat is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * pwnat is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with pwnat.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "StripedSocket.h"
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+#include <sstream>
+#include <pwnat/packet.h>
+#include <pwnat/Application.h>
+#include <boost/log/trivial.hpp>
+
+#include <pwnat/namespaces.h>
+
+const size_t StripedSocket::segment_size;
+const u_int32_t StripedSocket::reorder_window;
+const size_t StripedSocket::reorder_buffer_size;
+
+StripedSocket::StripedSocket(vector<shared_ptr<AbstractSocket>> stripes, asio::io_service::strand strand, DeathHandler death_handler) :
+    AbstractSocket(true, strand, death_handler, "Striped socket"),
+    m_stripes(stripes),
+    m_next_send_sequence(0),
+    m_next_receive_sequence(0),
+    m_out_of_order_size(0)
+{
+    assert(!m_stripes.empty());
+}
+
+StripedSocket::~StripedSocket() {
+    dispose();
+}
+
+void StripedSocket::start() {
+    for (auto& stripe : m_stripes) {
+        auto& stripe_ref = *stripe;
+        stripe->on_received_data(bind(&StripedSocket::handle_stripe_data, shared_from_this(), ref(stripe_ref), _1));
+        stripe->on_drained(bind(&StripedSocket::start_sending, shared_from_this()));
+    }
+}
+
+void StripedSocket::connect(u_int16_t source_port, asio::ip::address destination, u_int16_t destination_port) {
+    assert(false);
+}
+
+void StripedSocket::receive_data_from(AbstractSocket& socket) {
+    socket.on_received_data(bind(&StripedSocket::send, shared_from_this(), _1));
+    set_data_source(socket);
+}
+
+bool StripedSocket::dispose() {
+    if (AbstractSocket::dispose()) {
+        for (auto& stripe : m_stripes) {
+            stripe->dispose();
+        }
+        m_out_of_order_segments.clear();
+        m_out_of_order_size = 0;
+        m_held_stripes.clear();
+        return true;
+    }
+    else {
+        return false;
+    }
+}
+
+void StripedSocket::start_receiving() {
+    if (disposed()) return;
+
+    if (!receiving_paused()) {
+        if (m_receive_buffer.size() > 0) {
+            notify_received_data();
+        }
+        m_held_stripes.clear();  // Note: resumed below, a stripe still ahead is held again
+        for (auto& stripe : m_stripes) {
+            stripe->resume_receiving();  // this also hands us the segments it held while paused
+            if (disposed() || receiving_paused()) return;
+        }
+    }
+}
+
+void StripedSocket::start_sending() {
+    if (disposed()) return;
+
+    auto& args = Application::instance().args();
+    while (m_send_buffer.size() > 0) {
+        // pick the stripe with the least data queued
+        auto stripe = m_stripes.front();
+        for (auto& candidate : m_stripes) {
+            if (candidate->send_buffer_size() < stripe->send_buffer_size()) {
+                stripe = candidate;
+            }
+        }
+
+        if (stripe->send_buffer_size() >= args.send_buffer_high_watermark()) {
+            break;  // all stripes are full, continue when one drained
+        }
+
+        stripe_segment segment;
+        segment.sequence = m_next_send_sequence++;
+        segment.length = min(m_send_buffer.size(), segment_size);
+
+        ChunkBuffer buffer;
+        buffer.append(reinterpret_cast<const char*>(&segment), sizeof(stripe_segment));
+        buffer.append(m_send_buffer, segment.length);
+        stripe->send(buffer);
+    }
+    update_flow_control();
+}
+
+void StripedSocket::handle_stripe_data(AbstractSocket& stripe, ChunkBuffer& buffer) {
+    if (disposed()) return;
+
+    while (buffer.size() >= sizeof(stripe_segment)) {
+        if (receiving_paused()) {
+            stripe.pause_receiving();  // resumed by start_receiving
+            return;
+        }
+
+        stripe_segment segment;
+        buffer.copy(reinterpret_cast<char*>(&segment), sizeof(stripe_segment));
+        if (segment.length > segment_size) {
+            stringstream reason;
+            reason << "Invalid segment of " << segment.length << " bytes";
+            die(reason.str());
+            return;
+        }
+        u_int32_t distance = segment.sequence - m_next_receive_sequence;
+        if (static_cast<int32_t>(distance) < 0) {
+            stringstream reason;
+            reason << "Segment " << segment.sequence << " was already received, expected " << m_next_receive_sequence;
+            die(reason.str());
+            return;
+        }
+        if (distance > 0 && (distance >= reorder_window || m_out_of_order_size + segment.length > reorder_buffer_size)) {
+            // Note: the segments before it arrive over other stripes, which aren't held
+            hold(stripe);
+            return;
+        }
+        if (buffer.size() < sizeof(stripe_segment) + segment.length) {
+            break;
+        }
+
+        buffer.consume(sizeof(stripe_segment));
+        ChunkBuffer payload;
+        payload.append(buffer, segment.length);
+        handle_segment(segment.sequence, payload);
+        if (disposed()) return;
+    }
+}
+
+void StripedSocket::handle_segment(u_int32_t sequence, ChunkBuffer& payload) {
+    if (sequence != m_next_receive_sequence) {
+        if (m_out_of_order_segments.count(sequence)) {
+            stringstream reason;
+            reason << "Segment " << sequence << " received twice";
+            die(reason.str());
+            return;
+        }
+        m_out_of_order_size += payload.size();
+        m_out_of_order_segments[sequence].append(payload);
+        return;
+    }
+
+    m_receive_buffer.append(payload);
+    m_next_receive_sequence++;
+
+    // append segments that were waiting for this one
+    auto it = m_out_of_order_segments.find(m_next_receive_sequence);
+    while (it != m_out_of_order_segments.end()) {
+        m_out_of_order_size -= it->second.size();
+        m_receive_buffer.append(it->second);
+        m_out_of_order_segments.erase(it);
+        m_next_receive_sequence++;
+        it = m_out_of_order_segments.find(m_next_receive_sequence);
+    }
+
+    notify_received_data();
+    release_held_stripes();
+}
+
+void StripedSocket::hold(AbstractSocket& stripe) {
+    stripe.pause_receiving();
+    if (find(m_held_stripes.begin(), m_held_stripes.end(), &stripe) == m_held_stripes.end()) {
+        m_held_stripes.push_back(&stripe);
+    }
+}
+
+void StripedSocket::release_held_stripes() {
+    if (disposed() || receiving_paused()) return;  // start_receiving resumes all stripes
+
+    // Note: a resumed stripe may be held again, while we iterate
+    vector<AbstractSocket*> held;
+    held.swap(m_held_stripes);
+    for (auto stripe : held) {
+        stripe->resume_receiving();  // this also hands us the segments it held
+        if (disposed()) return;
+    }
+}
@@ -0,0 +1,83 @@
+/*
+ * Copyright (C) 2013 by Tim Diels
+ *
+ * This file is part of pwnat.
+ *
+ * pwnat is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * pwnat is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with pwnat.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <map>
+#include <memory>
+#include <vector>
+#include "AbstractSocket.h"
+
+/**
+ * Carries one flow over multiple sockets, see stripe_segment
+ *
+ * Data is cut into segments, each sent over the stripe with the least data
+ * queued. The receiving side puts segments back in order. Is connected from
+ * the start, stripes buffer data until they're connected.
+ *
+ * Stripes must use the strand of the striped socket, their death handlers
+ * remain those they were given. Disposing the striped socket disposes its
+ * stripes.
+ *
+ * A stripe whose next segment is further than reorder_window ahead, or would
+ * push the data held out of order over reorder_buffer_size, is paused until
+ * the segments missing before it arrive. This bounds what is buffered. A
+ * peer that sends segments larger than segment_size, or sends a segment
+ * twice, kills the striped socket.
+ */
+class StripedSocket : public AbstractSocket, public std::enable_shared_from_this<StripedSocket> {
+public:
+    static const size_t segment_size = 64 * 1024;
+    static const u_int32_t reorder_window = 1024; // max segments received ahead of the next one in sequence
+    static const size_t reorder_buffer_size = 4 * 1024 * 1024; // max bytes of segments received ahead of the next one in sequence
+
+public:
+    StripedSocket(std::vector<std::shared_ptr<AbstractSocket>> stripes, boost::asio::io_service::strand, DeathHandler);
+    ~StripedSocket();
+
+    /**
+     * Must be called once, before init
+     */
+    void start();
+
+    /**
+     * Not supported, stripes are connected by the owner
+     */
+    void connect(u_int16_t source_port, boost::asio::ip::address destination, u_int16_t destination_port);
+    void receive_data_from(AbstractSocket& socket);
+    bool dispose() override;
+
+protected:
+    void start_receiving();
+    void start_sending();
+
+private:
+    void handle_stripe_data(AbstractSocket& stripe, ChunkBuffer& buffer);
+    void handle_segment(u_int32_t sequence, ChunkBuffer& payload);
+    void hold(AbstractSocket& stripe);
+    void release_held_stripes();
+
+private:
+    std::vector<std::shared_ptr<AbstractSocket>> m_stripes;
+    u_int32_t m_next_send_sequence;
+    u_int32_t m_next_receive_sequence;
+    std::map<u_int32_t, ChunkBuffer> m_out_of_order_segments; // received ahead of m_next_receive_sequence
+    size_t m_out_of_order_size; // bytes in m_out_of_order_segments
+    std::vector<AbstractSocket*> m_held_stripes; // paused until m_next_receive_sequence advances
+};
@@ -19,21 +19,36 @@
 
 #include "UDTSocket.h"
 #include <sstream>
+#include <stdexcept>
 #include <cassert>
 #include <pwnat/util.h>
-#include <pwnat/udtservice/UDTService.h>
+#include <pwnat/udtservice/UDTServicePool.h>
 #include <pwnat/Application.h>
+#include <pwnat/metrics/Counter.h>
+#include <pwnat/Watchdog.h>
 #include <boost/log/trivial.hpp>
 
 #include <pwnat/namespaces.h>
 
-UDTSocket::UDTSocket(UDTService& udt_service, DeathHandler death_handler) :
-    AbstractSocket(false, death_handler, "UDT socket"),
-    m_udt_service(udt_service),
-    m_socket(UDT::socket(Application::instance().args().address_family(), SOCK_STREAM, 0))
+static Counter udt_bytes_received("pwnat_bytes_received_total{transport=\"udt\"}", "Bytes received from the network");
+static Counter udt_bytes_sent("pwnat_bytes_sent_total{transport=\"udt\"}", "Bytes sent onto the network");
+
+static const int EASYNCSND = 6001; // no room in UDT's send buffer
+static const int EASYNCRCV = 6002; // no data available to receive
+
+const size_t UDTSocket::wakeup_budget;
+
+UDTSocket::UDTSocket(UDTServicePool& udt_services, asio::io_service::strand strand, DeathHandler death_handler) :
+    AbstractSocket(false, strand, death_handler, "UDT socket"),
+    m_socket(UDT::socket(Application::instance().args().address_family(), SOCK_STREAM, 0)),
+    m_udt_service(udt_services.get(m_socket)),
+    m_sending(false),
+    m_bytes_sent(0),
+    m_bytes_received(0),
+    m_coalescer(strand, Application::instance().args().coalesce_bytes(), Application::instance().args().coalesce_delay())
 {
     if (m_socket == UDT::INVALID_SOCK) {
-        die(format_udt_error("Could not create UDTSOCKET"));
+        throw runtime_error(format_udt_error("Could not create UDTSOCKET"));  // Note: our owner isn't constructed yet, it can't handle our death
     }
 }
 
@@ -81,6 +96,7 @@ void UDTSocket::connect(u_int16_t source_port, asio::ip::address destination, u_
 
     if (UDT::ERROR == UDT::bind(m_socket, reinterpret_cast<sockaddr*>(source_addr.data()), source_addr.size())) {
         die(format_udt_error("Could not bind"));
+        return;
     }
 
     bool non_blocking_mode = false;
@@ -89,18 +105,41 @@ void UDTSocket::connect(u_int16_t source_port, asio::ip::address destination, u_
 
     if (UDT::ERROR == UDT::connect(m_socket, reinterpret_cast<sockaddr*>(dest_addr.data()), dest_addr.size())) {
         die(format_udt_error("Could not connect"));
+        return;
     }
 
     // find out when we're connected
-    m_udt_service.request_send(m_socket, bind(&UDTSocket::notify_connected, shared_from_this()));
+    stringstream description;
+    description << "UDT connection to " << destination << ":" << destination_port;
+    m_udt_service.request_send(m_socket, m_strand.wrap(Watchdog::watch(bind(&UDTSocket::handle_connected, shared_from_this(), description.str()))));
+}
+
+void UDTSocket::handle_connected(string description) {
+    if (disposed()) return;
+    Application::instance().udt_performance().add(shared_from_this(), description);
+    notify_connected();
+}
+
+bool UDTSocket::get_performance(UDT::TRACEINFO& info) {
+    return UDT::perfmon(m_socket, &info, true) != UDT::ERROR;
+}
+
+u_int64_t UDTSocket::bytes_sent() {
+    return m_bytes_sent.load(memory_order_relaxed);
+}
+
+u_int64_t UDTSocket::bytes_received() {
+    return m_bytes_received.load(memory_order_relaxed);
 }
 
 void UDTSocket::receive_data_from(AbstractSocket& socket) {
     socket.on_received_data(bind(&UDTSocket::send, shared_from_this(), _1));
+    set_data_source(socket);
 }
 
 bool UDTSocket::dispose() {
     if (AbstractSocket::dispose()) {
+        m_coalescer.reset();
         m_udt_service.request_unregister(m_socket);
         return true;
     }
@@ -111,60 +150,121 @@ bool UDTSocket::dispose() {
 
 void UDTSocket::start_receiving() {
     assert(connected());
-    m_udt_service.request_receive(m_socket, bind(&UDTSocket::handle_receive, shared_from_this()));
+    if (receiving_paused()) {
+        m_udt_service.cancel_receive(m_socket);
+    }
+    else {
+        m_udt_service.request_receive(m_socket, m_strand.wrap(Watchdog::watch(bind(&UDTSocket::handle_receive, shared_from_this()))));
+    }
 }
 
 void UDTSocket::start_sending() {
     assert(connected());
-    m_udt_service.request_send(m_socket, bind(&UDTSocket::handle_send, shared_from_this()));
+    if (m_sending) return;
+
+    // Only be interested in the send event while there's something to send
+    if (m_send_buffer.size() == 0) {
+        m_coalescer.reset();
+        m_udt_service.cancel_send(m_socket);
+    }
+    else if (m_coalescer.due(m_send_buffer.size(), bind(&UDTSocket::handle_flush_deadline, shared_from_this()))) {
+        m_sending = true;
+        m_udt_service.request_send(m_socket, m_strand.wrap(Watchdog::watch(bind(&UDTSocket::handle_send, shared_from_this()))));
+    }
+}
+
+void UDTSocket::handle_flush_deadline() {
+    if (disposed()) return;
+    start_sending();
+}
+
+void UDTSocket::set_no_delay(bool no_delay) {
+    if (disposed()) return;
+
+    m_coalescer.set_no_delay(no_delay);
+    if (connected()) {
+        start_sending();
+    }
 }
 
 void UDTSocket::handle_receive() {
     if (disposed()) return;
 
-    BOOST_LOG_TRIVIAL(trace) << "receiving" << endl;
-    const size_t buffer_size = 64 * 1024;
-    int bytes_transferred = UDT::recv(m_socket, asio::buffer_cast<char*>(m_receive_buffer.prepare(buffer_size)), buffer_size, 0);
-    if (bytes_transferred == UDT::ERROR) {
-        auto error = UDT::getlasterror();
-        const int EASYNCRCV = 6002; // no data available to receive
-        if (error.getErrorCode() != EASYNCRCV) {
-            die(format_udt_error("Failed to receive"));
+    // Drain the socket, as each wait for a receive event is a round-trip through the UDT service thread
+    size_t received = 0;
+    while (received < wakeup_budget && !receiving_paused()) {
+        auto buffer = m_receive_buffer.prepare(ChunkBuffer::chunk_size);
+        int bytes_transferred = UDT::recv(m_socket, asio::buffer_cast<char*>(buffer), asio::buffer_size(buffer), 0);
+        if (bytes_transferred == UDT::ERROR) {
+            if (UDT::getlasterror().getErrorCode() != EASYNCRCV) {
+                die(format_udt_error("Failed to receive"));
+                return;
+            }
+            break;
         }
-    }
-    else {
+
+        received += bytes_transferred;
         m_receive_buffer.commit(bytes_transferred);
+        udt_bytes_received.add(bytes_transferred);
+        m_bytes_received.store(m_bytes_received.load(memory_order_relaxed) + bytes_transferred, memory_order_relaxed);
         BOOST_LOG_TRIVIAL(trace)
             << m_name << " received " << bytes_transferred << ":" << endl
             << endl
-            << get_hex_dump(asio::buffer_cast<const unsigned char*>(m_receive_buffer.data()), m_receive_buffer.size());
+            << get_hex_dump(m_receive_buffer);
         notify_received_data();
+        if (disposed()) return;
     }
 
     start_receiving();
 }
 
 void UDTSocket::handle_send() {
-    if (disposed() || !connected() || m_send_buffer.size() == 0) return;
+    if (disposed()) return;
+
+    m_sending = false;
 
     BOOST_LOG_TRIVIAL(trace) 
         << "sending " << m_send_buffer.size() << ":" << endl
         << endl
-        << get_hex_dump(asio::buffer_cast<const unsigned char*>(m_send_buffer.data()), m_send_buffer.size()) << endl;
-    int bytes_transferred = UDT::send(m_socket, asio::buffer_cast<const char*>(m_send_buffer.data()), m_send_buffer.size(), 0);
-    if (bytes_transferred == UDT::ERROR) {
-        die(format_udt_error("Failed to send"));
-    }
-    else {
+        << get_hex_dump(m_send_buffer) << endl;
+
+    // UDT::send has no gather variant, send chunk by chunk until UDT's buffer is full
+    size_t sent = 0;
+    bool udt_buffer_full = false;
+    for (auto& buffer : m_send_buffer.data()) {
+        if (sent >= wakeup_budget) break;
+
+        size_t size = min(asio::buffer_size(buffer), wakeup_budget - sent);
+        int bytes_transferred = UDT::send(m_socket, asio::buffer_cast<const char*>(buffer), size, 0);
+        if (bytes_transferred == UDT::ERROR) {
+            if (UDT::getlasterror().getErrorCode() != EASYNCSND) {
+                die(format_udt_error("Failed to send"));
+                return;
+            }
+            udt_buffer_full = true;
+            break;
+        }
+
         BOOST_LOG_TRIVIAL(trace) << m_name << " sent " << bytes_transferred << endl;
+        sent += bytes_transferred;
         m_send_buffer.consume(bytes_transferred);
+        udt_bytes_sent.add(bytes_transferred);
+        m_bytes_sent.store(m_bytes_sent.load(memory_order_relaxed) + bytes_transferred, memory_order_relaxed);
+        update_flow_control();
+        if (disposed()) return;
+        if (static_cast<size_t>(bytes_transferred) < size) {
+            udt_buffer_full = true;
+            break;
+        }
     }
 
     if (m_send_buffer.size() > 0) {
-        // didn't manage to send everything, assume internal buffer is full
-        BOOST_LOG_TRIVIAL(trace) << m_name << ": send buffer full, waiting" << endl;
-        start_sending();
+        if (udt_buffer_full) {
+            BOOST_LOG_TRIVIAL(trace) << m_name << ": send buffer full, waiting" << endl;
+        }
+        m_coalescer.expire();  // the rest was due already
     }
+    start_sending();
 }
 
 u_int16_t UDTSocket::local_port() {
@@ -179,6 +279,7 @@ u_int16_t UDTSocket::local_port() {
     int size = addr_data.size();
     if (UDT::getsockname(m_socket, reinterpret_cast<sockaddr*>(addr_data.data()), &size) == UDT::ERROR) {
         die(format_udt_error("Failed to get local endpoint"));
+        return 0;
     }
 
     if (Application::instance().args().is_ipv6()) {
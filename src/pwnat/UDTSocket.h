@@ -20,26 +20,39 @@
 #pragma once
 
 #include <udt/udt.h>
+#include <atomic>
 #include <memory>
 #include "AbstractSocket.h"
+#include "SendCoalescer.h"
 
 class UDTService;
+class UDTServicePool;
 
 /**
  * Convenient rendezvous UDT socket for sending/receiving
  *
+ * Small sends are coalesced: data is only handed to UDT once coalesce_bytes()
+ * are buffered, or coalesce_delay() after the first of them was buffered,
+ * whichever comes first. Unless no delay is set.
  */
 class UDTSocket : public AbstractSocket, public std::enable_shared_from_this<UDTSocket> {
+public:
+    static const size_t wakeup_budget = 1024 * 1024; // max bytes received or sent per event, so other sockets of the UDT service get their turn
+
 public:
     /**
      * Construct a socket that has yet to connect
+     *
+     * The socket is handled by one of the services of the pool for its whole lifetime.
+     *
+     * Throws runtime_error if no UDT socket could be created.
      */
-    UDTSocket(UDTService&, DeathHandler);
+    UDTSocket(UDTServicePool&, boost::asio::io_service::strand, DeathHandler);
     ~UDTSocket();
 
     void connect(u_int16_t source_port, boost::asio::ip::address destination, u_int16_t destination_port);
     void receive_data_from(AbstractSocket& socket);
-    bool dispose();
+    bool dispose() override;
 
     /*
      * Get currently bound port.
@@ -48,16 +61,41 @@ public:
      */
     u_int16_t local_port();
 
+    /**
+     * Get UDT's performance statistics, interval values are since the last call
+     *
+     * Returns false if the socket is no longer usable. Thread safe
+     */
+    bool get_performance(UDT::TRACEINFO& info);
+
+    /**
+     * Get bytes sent/received over the connection so far. Thread safe
+     */
+    u_int64_t bytes_sent();
+    u_int64_t bytes_received();
+
+    /**
+     * Whether to hand data to UDT as soon as it can be sent, without coalescing
+     */
+    void set_no_delay(bool no_delay);
+
 protected:
     void start_receiving();
     void start_sending();
 
 private:
+    void handle_connected(std::string description);
     void handle_receive();
     void handle_send();
+    void handle_flush_deadline();
 
 private:
-    UDTService& m_udt_service;
     UDTSOCKET m_socket;
+    UDTService& m_udt_service;
+    bool m_sending; // whether registered for or handling a send event
+    std::atomic<u_int64_t> m_bytes_sent; // only written in our strand
+    std::atomic<u_int64_t> m_bytes_received;
+
+    SendCoalescer m_coalescer;
 };
 
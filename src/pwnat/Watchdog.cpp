@@ -0,0 +1,186 @@
+/*
+ * Copyright (C) 2013 by Tim Diels
+ *
+ * This file is part of pwnat.
+ *
+ * pwnat is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * pwnat is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with pwnat.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "Watchdog.h"
+#include <csignal>
+#include <cstdlib>
+#include <sstream>
+#include <execinfo.h>
+#include <pwnat/metrics/Histogram.h>
+#include <boost/log/trivial.hpp>
+
+#include <pwnat/namespaces.h>
+
+static Histogram event_loop_lag("pwnat_event_loop_lag_seconds", "loop=\"io\"", "Delay before a handler posted to an event loop runs");
+
+static const int backtrace_signal = SIGUSR2;
+
+thread_local Watchdog::IoThread* Watchdog::t_io_thread = nullptr;
+
+Watchdog::IoThread::IoThread() :
+    thread(pthread_self()),
+    handler_started(0),
+    stall_reported(0),
+    frame_count(0),
+    backtrace_ready(false)
+{
+}
+
+Watchdog::HandlerScope::HandlerScope() :
+    m_io_thread(t_io_thread)
+{
+    if (m_io_thread && !m_io_thread->handler_started.load(memory_order_relaxed)) {
+        m_io_thread->handler_started.store(chrono::steady_clock::now().time_since_epoch().count(), memory_order_relaxed);
+    }
+    else {
+        m_io_thread = nullptr;
+    }
+}
+
+Watchdog::HandlerScope::~HandlerScope() {
+    if (m_io_thread) {
+        m_io_thread->handler_started.store(0, memory_order_relaxed);
+    }
+}
+
+Watchdog::Watchdog(asio::io_service& io_service, long interval, long stall_threshold) :
+    m_io_service(io_service),
+    m_interval(interval),
+    m_stall_threshold(stall_threshold),
+    m_heartbeat_pending(false)
+{
+    // Note: backtrace loads libgcc on first use, which isn't safe to do in a signal handler
+    void* frame;
+    backtrace(&frame, 1);
+
+    struct sigaction action = {};
+    action.sa_handler = &Watchdog::handle_backtrace_signal;
+    sigemptyset(&action.sa_mask);
+    action.sa_flags = SA_RESTART;
+    sigaction(backtrace_signal, &action, nullptr);
+
+    m_thread = boost::thread(bind(&Watchdog::run, this));
+}
+
+Watchdog::~Watchdog() {
+    m_thread.interrupt();
+    m_thread.join();
+}
+
+void Watchdog::add_thread() {
+    boost::lock_guard<boost::mutex> guard(m_threads_lock);
+    m_threads.push_back(unique_ptr<IoThread>(new IoThread));
+    t_io_thread = m_threads.back().get();
+}
+
+void Watchdog::run() {
+    bool stall_reported = false;
+    try {
+        while (true) {
+            boost::this_thread::sleep(boost::posix_time::milliseconds(m_interval.count()));
+            if (m_io_service.stopped()) {
+                continue; // io threads are exiting, they may no longer be signalled
+            }
+
+            auto now = chrono::steady_clock::now();
+            check_io_threads(now);
+            if (m_heartbeat_pending) {
+                auto lag = now - m_heartbeat_posted;
+                if (lag >= m_stall_threshold && !stall_reported) {
+                    report_stall(lag);
+                    stall_reported = true;
+                }
+            }
+            else {
+                stall_reported = false;
+                m_heartbeat_pending = true;
+                m_heartbeat_posted = now;
+                m_io_service.post(bind(&Watchdog::handle_heartbeat, this, now));
+            }
+        }
+    }
+    catch (const boost::thread_interrupted&) {
+    }
+}
+
+void Watchdog::check_io_threads(chrono::steady_clock::time_point now) {
+    boost::lock_guard<boost::mutex> guard(m_threads_lock);
+    for (size_t i = 0; i < m_threads.size(); i++) {
+        auto& io_thread = *m_threads.at(i);
+        auto started = io_thread.handler_started.load(memory_order_relaxed);
+        if (!started || started == io_thread.stall_reported) {
+            continue;
+        }
+
+        auto busy = now - chrono::steady_clock::time_point(chrono::steady_clock::duration(started));
+        if (busy >= m_stall_threshold) {
+            io_thread.stall_reported = started;
+            BOOST_LOG_TRIVIAL(warning) << "Warning: io thread " << i << " stalled in a handler for over " << chrono::duration_cast<chrono::milliseconds>(busy).count() << " ms" << endl;
+            log_backtrace(i);
+        }
+    }
+}
+
+void Watchdog::handle_heartbeat(chrono::steady_clock::time_point posted) {
+    auto lag = chrono::steady_clock::now() - posted;
+    event_loop_lag.record(lag);
+    if (lag >= m_stall_threshold) {
+        BOOST_LOG_TRIVIAL(warning) << "Warning: io threads stalled for " << chrono::duration_cast<chrono::milliseconds>(lag).count() << " ms" << endl;
+    }
+    m_heartbeat_pending = false;
+}
+
+void Watchdog::report_stall(chrono::steady_clock::duration lag) {
+    BOOST_LOG_TRIVIAL(warning) << "Warning: io threads stalled for over " << chrono::duration_cast<chrono::milliseconds>(lag).count() << " ms" << endl;
+
+    boost::lock_guard<boost::mutex> guard(m_threads_lock);
+    for (size_t i = 0; i < m_threads.size(); i++) {
+        log_backtrace(i);
+    }
+}
+
+void Watchdog::log_backtrace(size_t index) {
+    // Note: caller holds m_threads_lock
+    auto& io_thread = *m_threads.at(index);
+    io_thread.backtrace_ready = false;
+    pthread_kill(io_thread.thread, backtrace_signal);
+    for (int i = 0; i < 100 && !io_thread.backtrace_ready; i++) {
+        boost::this_thread::sleep(boost::posix_time::milliseconds(1));
+    }
+    if (!io_thread.backtrace_ready) {
+        BOOST_LOG_TRIVIAL(warning) << "Warning: io thread " << index << " didn't take its backtrace" << endl;
+        return;
+    }
+
+    stringstream lines;
+    char** symbols = backtrace_symbols(io_thread.frames, io_thread.frame_count);
+    for (int i = 0; i < io_thread.frame_count; i++) {
+        lines << "\n    " << (symbols ? symbols[i] : "?");
+    }
+    free(symbols);
+    BOOST_LOG_TRIVIAL(warning) << "Backtrace of io thread " << index << ":" << lines.str() << endl;
+}
+
+void Watchdog::handle_backtrace_signal(int) {
+    // Note: only async signal safe calls
+    auto io_thread = t_io_thread;
+    if (!io_thread) return;
+    io_thread->frame_count = backtrace(io_thread->frames, IoThread::max_frames);
+    io_thread->backtrace_ready = true;
+}
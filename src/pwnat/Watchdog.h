@@ -0,0 +1,146 @@
+/*
+ * Copyright (C) 2013 by Tim Diels
+ *
+ * This file is part of pwnat.
+ *
+ * pwnat is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * pwnat is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with pwnat.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <utility>
+#include <vector>
+#include <pthread.h>
+#include <boost/asio.hpp>
+#include <boost/thread.hpp>
+
+/**
+ * Measures how late handlers of an io_service run, and reports stalls
+ *
+ * A thread of its own posts a heartbeat into the io_service every interval,
+ * the delay until it runs is recorded as the event loop lag. When a heartbeat
+ * hasn't run after the stall threshold, all io threads are stalled and a
+ * warning is logged along with a backtrace of each io thread.
+ *
+ * A single io thread can stall while the others keep running heartbeats, e.g.
+ * on a tunnel's strand. Handlers wrapped with watch() are timed on the io
+ * thread running them, when one runs longer than the stall threshold a warning
+ * is logged along with the backtrace of that thread, which shows where the
+ * handler is blocking.
+ *
+ * Thread safe.
+ */
+class Watchdog {
+private:
+    struct IoThread;
+
+public:
+    template <typename Handler>
+    class WatchedHandler {
+    public:
+        WatchedHandler(Handler handler) :
+            m_handler(std::move(handler))
+        {
+        }
+
+        template <typename... Args>
+        void operator()(Args&&... args) {
+            HandlerScope scope;
+            m_handler(std::forward<Args>(args)...);
+        }
+
+    private:
+        Handler m_handler;
+    };
+
+public:
+    /**
+     * interval: ms between heartbeats
+     * stall_threshold: ms of lag after which a stall is reported
+     */
+    Watchdog(boost::asio::io_service&, long interval, long stall_threshold);
+    ~Watchdog();
+
+    /**
+     * Register calling thread as a thread running the io_service, to be included in stall reports
+     */
+    void add_thread();
+
+    /**
+     * Wrap handler so that it's timed on the io thread running it
+     *
+     * Wrap the handler itself, not its strand.wrap(), or the time spent
+     * waiting on the strand is counted as well. Costs a thread local lookup
+     * when there's no watchdog.
+     */
+    template <typename Handler>
+    static WatchedHandler<Handler> watch(Handler handler) {
+        return WatchedHandler<Handler>(std::move(handler));
+    }
+
+private:
+    /**
+     * Marks the calling io thread busy with a handler while in scope
+     *
+     * Nested handlers, e.g. one dispatched from another, count as part of the outer one.
+     */
+    class HandlerScope {
+    public:
+        HandlerScope();
+        ~HandlerScope();
+
+    private:
+        IoThread* m_io_thread; // nullptr if nested or not on an io thread
+    };
+
+    struct IoThread {
+        IoThread();
+
+        pthread_t thread;
+        std::atomic<std::chrono::steady_clock::rep> handler_started; // start of the current watched handler, 0 if none
+        std::chrono::steady_clock::rep stall_reported; // handler_started of the last stall reported, only accessed by m_thread
+
+        // written by handle_backtrace_signal
+        static const int max_frames = 64;
+        void* frames[max_frames];
+        int frame_count;
+        std::atomic<bool> backtrace_ready;
+    };
+
+private:
+    void run();
+    void check_io_threads(std::chrono::steady_clock::time_point now);
+    void handle_heartbeat(std::chrono::steady_clock::time_point posted);
+    void report_stall(std::chrono::steady_clock::duration lag);
+    void log_backtrace(size_t index);
+    static void handle_backtrace_signal(int);
+
+private:
+    static thread_local IoThread* t_io_thread;
+
+    boost::asio::io_service& m_io_service;
+    const std::chrono::milliseconds m_interval;
+    const std::chrono::milliseconds m_stall_threshold;
+
+    std::atomic<bool> m_heartbeat_pending;
+    std::chrono::steady_clock::time_point m_heartbeat_posted; // only accessed by m_thread
+
+    boost::mutex m_threads_lock;
+    std::vector<std::unique_ptr<IoThread>> m_threads;
+
+    boost::thread m_thread;
+};
@@ -1,17 +1,130 @@
 
 #include "checksum.h"
+#include <cstring>
 
-uint16_t get_checksum(uint16_t *data, int bytes)
-{
-    uint32_t sum;
-    int i;
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+    #define HAVE_X86_SIMD
+    #include <immintrin.h>
+#endif
 
-    sum = 0;
-    for (i=0;i<bytes/2;i++) {
-            sum += data[i];
+// Sums of native 16-bit words: one's complement addition doesn't care about
+// byte order, as long as the result is stored in the same order.
+
+static uint64_t add_to_checksum_scalar(uint64_t sum, const unsigned char* data, size_t bytes) {
+    while (bytes >= 2) {
+        uint16_t word;
+        memcpy(&word, data, 2);
+        sum += word;
+        data += 2;
+        bytes -= 2;
+    }
+
+    if (bytes) {
+        uint16_t word = 0;
+        memcpy(&word, data, 1);  // pad with zero byte
+        sum += word;
     }
-    sum = (sum & 0xFFFF) + (sum >> 16);
-    sum = htons(0xFFFF - sum);
     return sum;
 }
 
+#ifdef HAVE_X86_SIMD
+
+// Note: 32-bit lanes take at most 2^16 words each before they could overflow
+static const size_t max_vectors_per_block = 0x8000;
+
+__attribute__((target("sse2")))
+static uint64_t add_to_checksum_sse2(uint64_t sum, const unsigned char* data, size_t bytes) {
+    const __m128i zero = _mm_setzero_si128();
+    while (bytes >= 16) {
+        __m128i lanes = zero;
+        size_t vectors = bytes / 16 < max_vectors_per_block ? bytes / 16 : max_vectors_per_block;
+        for (size_t i = 0; i < vectors; i++) {
+            __m128i words = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data));
+            lanes = _mm_add_epi32(lanes, _mm_unpacklo_epi16(words, zero));
+            lanes = _mm_add_epi32(lanes, _mm_unpackhi_epi16(words, zero));
+            data += 16;
+        }
+        bytes -= vectors * 16;
+
+        uint32_t lane_sums[4];
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(lane_sums), lanes);
+        sum += static_cast<uint64_t>(lane_sums[0]) + lane_sums[1] + lane_sums[2] + lane_sums[3];
+    }
+    return add_to_checksum_scalar(sum, data, bytes);
+}
+
+__attribute__((target("avx2")))
+static uint64_t add_to_checksum_avx2(uint64_t sum, const unsigned char* data, size_t bytes) {
+    const __m256i zero = _mm256_setzero_si256();
+    while (bytes >= 32) {
+        __m256i lanes = zero;
+        size_t vectors = bytes / 32 < max_vectors_per_block ? bytes / 32 : max_vectors_per_block;
+        for (size_t i = 0; i < vectors; i++) {
+            __m256i words = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data));
+            lanes = _mm256_add_epi32(lanes, _mm256_unpacklo_epi16(words, zero));
+            lanes = _mm256_add_epi32(lanes, _mm256_unpackhi_epi16(words, zero));
+            data += 32;
+        }
+        bytes -= vectors * 32;
+
+        uint32_t lane_sums[8];
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(lane_sums), lanes);
+        for (int i = 0; i < 8; i++) {
+            sum += lane_sums[i];
+        }
+    }
+    return add_to_checksum_scalar(sum, data, bytes);  // Note: not sse2, mixing in legacy SSE code after AVX stalls
+}
+
+typedef uint64_t (*ChecksumFunction)(uint64_t, const unsigned char*, size_t);
+
+static ChecksumFunction pick_checksum_function() {
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        return add_to_checksum_avx2;
+    }
+    else if (__builtin_cpu_supports("sse2")) {
+        return add_to_checksum_sse2;
+    }
+    else {
+        return add_to_checksum_scalar;
+    }
+}
+
+#endif
+
+uint64_t add_to_checksum(uint64_t sum, const void* data, size_t bytes) {
+    auto bytes_data = static_cast<const unsigned char*>(data);
+
+    // small buffers, like most of our packets, aren't worth the vector setup
+    const size_t min_simd_size = 64;
+    if (bytes < min_simd_size) {
+        return add_to_checksum_scalar(sum, bytes_data, bytes);
+    }
+
+#ifdef HAVE_X86_SIMD
+    static const ChecksumFunction checksum_function = pick_checksum_function();
+    return checksum_function(sum, bytes_data, bytes);
+#else
+    return add_to_checksum_scalar(sum, bytes_data, bytes);
+#endif
+}
+
+uint16_t finish_checksum(uint64_t sum) {
+    while (sum >> 16) {
+        sum = (sum & 0xFFFF) + (sum >> 16);
+    }
+    return static_cast<uint16_t>(~sum);
+}
+
+uint16_t get_checksum(const void* data, size_t bytes) {
+    return finish_checksum(add_to_checksum(0, data, bytes));
+}
+
+uint16_t update_checksum(uint16_t checksum, uint16_t old_word, uint16_t new_word) {
+    // HC' = ~(~HC + ~m + m')
+    uint32_t sum = static_cast<uint16_t>(~checksum);
+    sum += static_cast<uint16_t>(~old_word);
+    sum += new_word;
+    return finish_checksum(sum);
+}
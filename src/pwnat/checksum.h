@@ -1,10 +1,34 @@
-
 #pragma once
 
 //	Includes
 #ifndef WIN32
   	#include	<netinet/in.h>
 #endif /* !WIN32 */
+#include <cstddef>
+
+/**
+ * Internet checksum (RFC 1071) of data
+ *
+ * An odd trailing byte is padded with a zero byte. Returns the checksum as
+ * it is to be stored in the packet, no byte order conversion needed.
+ */
+uint16_t get_checksum(const void* data, size_t bytes);
+
+/**
+ * Add data to a partial one's complement sum, as used by get_checksum
+ *
+ * Lets you checksum data in pieces; all pieces but the last must have an even size.
+ */
+uint64_t add_to_checksum(uint64_t sum, const void* data, size_t bytes);
 
-uint16_t get_checksum(uint16_t *data, int bytes);
+/**
+ * Turn a partial sum into a checksum as get_checksum returns it
+ */
+uint16_t finish_checksum(uint64_t sum);
 
+/**
+ * Update a checksum after a 16-bit word of the checksummed data changed (RFC 1624, eqn. 3)
+ *
+ * checksum, old_word and new_word as stored in the packet.
+ */
+uint16_t update_checksum(uint16_t checksum, uint16_t old_word, uint16_t new_word);
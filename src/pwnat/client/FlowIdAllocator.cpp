@@ -0,0 +1,82 @@
+/*
+ * Copyright (C) 2013 by Tim Diels
+ *
+ * This file is part of pwnat.
+ *
+ * pwnat is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * pwnat is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with pwnat.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "FlowIdAllocator.h"
+#include <stdexcept>
+
+#include <pwnat/namespaces.h>
+
+using boost::posix_time::ptime;
+using boost::posix_time::microsec_clock;
+
+const long FlowIdAllocator::quarantine_seconds;
+
+FlowId::FlowId(shared_ptr<FlowIdAllocator> allocator, u_int16_t value) :
+    m_allocator(allocator),
+    m_value(value)
+{
+}
+
+FlowId::~FlowId() {
+    m_allocator->release(m_value);
+}
+
+u_int16_t FlowId::value() const {
+    return m_value;
+}
+
+FlowIdAllocator::FlowIdAllocator(boost::posix_time::time_duration quarantine) :
+    m_quarantine_duration(quarantine),
+    m_used(0x10000, false),
+    m_used_count(1),
+    m_next_id(1)
+{
+    m_used[0] = true;  // reserved, the server sends its echoes with id 0
+}
+
+shared_ptr<FlowId> FlowIdAllocator::allocate() {
+    boost::lock_guard<boost::mutex> guard(m_lock);
+    expire_quarantine();
+
+    if (m_used_count == m_used.size()) {
+        throw runtime_error("All flow ids are in use");
+    }
+
+    while (m_used[m_next_id]) {
+        m_next_id++;  // Note: wraps around
+    }
+    u_int16_t id = m_next_id++;
+    m_used[id] = true;
+    m_used_count++;
+    return make_shared<FlowId>(shared_from_this(), id);
+}
+
+void FlowIdAllocator::release(u_int16_t id) {
+    boost::lock_guard<boost::mutex> guard(m_lock);
+    m_quarantine.push_back(make_pair(microsec_clock::universal_time(), id));
+}
+
+void FlowIdAllocator::expire_quarantine() {
+    auto expired = microsec_clock::universal_time() - m_quarantine_duration;
+    while (!m_quarantine.empty() && m_quarantine.front().first <= expired) {
+        m_used[m_quarantine.front().second] = false;
+        m_used_count--;
+        m_quarantine.pop_front();
+    }
+}
@@ -0,0 +1,88 @@
+/*
+ * Copyright (C) 2013 by Tim Diels
+ *
+ * This file is part of pwnat.
+ *
+ * pwnat is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * pwnat is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with pwnat.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <deque>
+#include <memory>
+#include <vector>
+#include <boost/noncopyable.hpp>
+#include <boost/thread.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
+
+class FlowIdAllocator;
+
+/**
+ * Flow id in use, given back to its allocator when destroyed
+ *
+ * The UDT connections of a striped flow share one.
+ */
+class FlowId : public boost::noncopyable {
+public:
+    FlowId(std::shared_ptr<FlowIdAllocator>, u_int16_t value);
+    ~FlowId();
+
+    u_int16_t value() const;
+
+private:
+    std::shared_ptr<FlowIdAllocator> m_allocator;
+    const u_int16_t m_value;
+};
+
+/**
+ * Hands out flow ids that are not in use. Thread safe
+ *
+ * The server identifies a flow by client address, flow id and the client's
+ * UDT port. A released id is quarantined before it's handed out again, long
+ * enough for the server to have forgotten a flow that never started (see
+ * ProxyClient::flow_init_timeout). So a new flow can only collide with a
+ * stale one when all ids are taken, in which case allocate throws instead.
+ */
+class FlowIdAllocator : public std::enable_shared_from_this<FlowIdAllocator>, public boost::noncopyable {
+public:
+    static const long quarantine_seconds = 60;
+
+public:
+    /**
+     * quarantine: how long a released id is not handed out
+     */
+    FlowIdAllocator(boost::posix_time::time_duration quarantine = boost::posix_time::seconds(quarantine_seconds));
+
+    /**
+     * Allocate an id that is neither in use nor quarantined
+     *
+     * Throws runtime_error when there's none.
+     */
+    std::shared_ptr<FlowId> allocate();
+
+private:
+    friend class FlowId;
+    void release(u_int16_t id);
+
+    // Note: m_lock must be held
+    void expire_quarantine();
+
+private:
+    const boost::posix_time::time_duration m_quarantine_duration;
+    boost::mutex m_lock;
+    std::vector<bool> m_used; // whether an id is in use or quarantined
+    size_t m_used_count;
+    std::deque<std::pair<boost::posix_time::ptime, u_int16_t>> m_quarantine; // in order of release
+    u_int16_t m_next_id; // where to start looking for an unused id
+};
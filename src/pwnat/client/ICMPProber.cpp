@@ -0,0 +1,150 @@
+/*
+ * Copyright (C) 2013 by Tim Diels
+ *
+ * This file is part of pwnat.
+ *
+ * pwnat is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * pwnat is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with pwnat.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "ICMPProber.h"
+#include <sys/socket.h>
+#include <cerrno>
+#include <cstring>
+#include <pwnat/Application.h>
+#include <pwnat/metrics/Counter.h>
+#include <boost/log/trivial.hpp>
+
+#include <pwnat/namespaces.h>
+
+static Counter probes_sent("pwnat_icmp_probes_sent_total", "ICMP ttl exceeded probes sent by the client");
+
+const long ICMPProber::tick_ms;
+const size_t ICMPProber::wheel_size;
+
+ICMPProber::ICMPProber(asio::io_service& io_service) :
+    m_socket(io_service, asio::ip::icmp::endpoint(Application::instance().args().icmp_version(), 0)),
+    m_timer(io_service),
+    m_wheel(wheel_size),
+    m_current_slot(0),
+    m_next_id(1),
+    m_timer_running(false)
+{
+    m_socket.connect(asio::ip::icmp::endpoint(Application::instance().args().proxy_host(), 0u));
+    m_socket.non_blocking(true);
+}
+
+ICMPProber::~ICMPProber() {
+    m_timer.cancel();
+}
+
+ICMPProber::ProbeId ICMPProber::add(const vector<char>& packet) {
+    boost::lock_guard<boost::mutex> guard(m_lock);
+    ProbeId id = m_next_id++;
+    auto& probe = m_probes[id];
+    probe.packet = make_shared<const vector<char>>(packet);
+    probe.sent = 0;
+    schedule(id, probe, 0);
+
+    if (!m_timer_running) {
+        m_timer_running = true;
+        start_timer();
+    }
+    return id;
+}
+
+void ICMPProber::cancel(ProbeId id) {
+    boost::lock_guard<boost::mutex> guard(m_lock);
+    m_probes.erase(id);
+}
+
+// Note: m_lock must be held
+void ICMPProber::schedule(ProbeId id, Probe& probe, long delay_ms) {
+    size_t ticks = max(1l, delay_ms / tick_ms);  // Note: the current slot is being handled or just was
+    probe.rounds = (ticks - 1) / wheel_size;
+    m_wheel[(m_current_slot + ticks) % wheel_size].push_back(id);
+}
+
+void ICMPProber::start_timer() {
+    m_timer.expires_from_now(boost::posix_time::milliseconds(tick_ms));
+    m_timer.async_wait(bind(&ICMPProber::handle_tick, this, asio::placeholders::error));
+}
+
+void ICMPProber::handle_tick(const boost::system::error_code& error) {
+    if (error) {
+        if (error.value() != asio::error::operation_aborted) {  // aborted = timer cancelled
+            BOOST_LOG_TRIVIAL(warning) << "Warning: Unexpected timer error: " << error.message() << endl;
+        }
+        return;
+    }
+
+    vector<shared_ptr<const vector<char>>> packets;
+    {
+        boost::lock_guard<boost::mutex> guard(m_lock);
+        m_current_slot = (m_current_slot + 1) % wheel_size;
+
+        vector<ProbeId> slot;
+        slot.swap(m_wheel[m_current_slot]);
+        for (auto id : slot) {
+            auto it = m_probes.find(id);
+            if (it == m_probes.end()) {
+                continue;  // cancelled
+            }
+
+            auto& probe = it->second;
+            if (probe.rounds > 0) {
+                probe.rounds--;
+                m_wheel[m_current_slot].push_back(id);
+            }
+            else {
+                packets.push_back(probe.packet);
+                schedule(id, probe, m_schedule.get_delay(probe.sent++));
+            }
+        }
+
+        if (m_probes.empty()) {
+            m_timer_running = false;
+        }
+        else {
+            start_timer();
+        }
+    }
+
+    send(packets);
+}
+
+void ICMPProber::send(const vector<shared_ptr<const vector<char>>>& packets) {
+    if (packets.empty()) return;
+
+    vector<iovec> iovecs(packets.size());
+    vector<mmsghdr> messages(packets.size());
+    for (size_t i = 0; i < packets.size(); i++) {
+        iovecs[i].iov_base = const_cast<char*>(packets[i]->data());
+        iovecs[i].iov_len = packets[i]->size();
+        messages[i] = mmsghdr();
+        messages[i].msg_hdr.msg_iov = &iovecs[i];
+        messages[i].msg_hdr.msg_iovlen = 1;
+    }
+
+    size_t sent = 0;
+    while (sent < messages.size()) {
+        int result = sendmmsg(m_socket.native_handle(), messages.data() + sent, messages.size() - sent, 0);
+        if (result < 0) {
+            // Note: probes that weren't sent are sent again next interval
+            BOOST_LOG_TRIVIAL(warning) << "Warning: send icmp ttl exceeded failed: " << strerror(errno) << endl;
+            break;
+        }
+        sent += result;
+        probes_sent.add(result);
+    }
+}
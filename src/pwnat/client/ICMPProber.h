@@ -0,0 +1,86 @@
+/*
+ * Copyright (C) 2013 by Tim Diels
+ *
+ * This file is part of pwnat.
+ *
+ * pwnat is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * pwnat is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with pwnat.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <map>
+#include <memory>
+#include <vector>
+#include <boost/asio.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/thread.hpp>
+#include <pwnat/ProbeSchedule.h>
+
+/**
+ * Sends the ICMP probes of all ProxyConnections over a single raw socket
+ *
+ * Each probe is resent according to the ProbeSchedule until cancelled.
+ * Deadlines are kept in a hashed timer wheel; each tick sends all due probes
+ * with one sendmmsg.
+ *
+ * Thread safe.
+ */
+class ICMPProber : boost::noncopyable {
+public:
+    typedef u_int64_t ProbeId;
+
+    static const long tick_ms = 10;
+    static const size_t wheel_size = 1024; // slots, a revolution takes wheel_size * tick_ms
+
+public:
+    ICMPProber(boost::asio::io_service&);
+    ~ICMPProber();
+
+    /**
+     * Start sending packet to the proxy host, until cancelled
+     *
+     * The first probe is sent on the next tick.
+     */
+    ProbeId add(const std::vector<char>& packet);
+
+    /**
+     * Stop sending probe. Does nothing if it was already cancelled
+     */
+    void cancel(ProbeId);
+
+private:
+    struct Probe {
+        std::shared_ptr<const std::vector<char>> packet;
+        size_t rounds; // revolutions of the wheel left before it's due
+        size_t sent; // number of times sent
+    };
+
+private:
+    void schedule(ProbeId, Probe&, long delay_ms);
+    void start_timer();
+    void handle_tick(const boost::system::error_code& error);
+    void send(const std::vector<std::shared_ptr<const std::vector<char>>>& packets);
+
+private:
+    boost::asio::ip::icmp::socket m_socket;
+    boost::asio::deadline_timer m_timer;
+    const ProbeSchedule m_schedule;
+
+    boost::mutex m_lock; // guards the members below
+    std::map<ProbeId, Probe> m_probes;
+    std::vector<std::vector<ProbeId>> m_wheel; // Note: cancelled probes are skipped when their slot comes up
+    size_t m_current_slot;
+    ProbeId m_next_id;
+    bool m_timer_running;
+};
@@ -0,0 +1,198 @@
+/*
+ * Copyright (C) 2013 by Tim Diels
+ *
+ * This file is part of pwnat.
+ *
+ * pwnat is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * pwnat is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with pwnat.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "ProxyConnection.h"
+#include <boost/bind.hpp>
+#include <pwnat/udtservice/UDTServicePool.h>
+#include <pwnat/checksum.h>
+#include <pwnat/packet.h>
+#include <pwnat/Application.h>
+#include <pwnat/metrics/Histogram.h>
+#include <boost/log/trivial.hpp>
+
+#include <pwnat/namespaces.h>
+
+static Histogram udt_connect_time("pwnat_setup_seconds", "side=\"client\",stage=\"udt_connect\"", "Time taken by each stage of setting up a tunnel");
+
+ProxyConnection::ProxyConnection(UDTServicePool& udt_services, ICMPProber& prober, asio::io_service::strand strand, shared_ptr<FlowId> flow_id, AbstractSocket::DeathHandler death_handler) :
+    m_strand(strand),
+    m_flow_id(flow_id),
+    m_death_handler(death_handler),
+    m_connected_handler([](){}),
+    m_started(false),
+    m_dead(false),
+    m_prober(prober),
+    m_probe(0),
+    m_udt_socket(make_shared<UDTSocket>(udt_services, strand, bind(&ProxyConnection::die, this)))
+{
+}
+
+ProxyConnection::~ProxyConnection() {
+    dispose();
+}
+
+void ProxyConnection::start() {
+    if (m_started) return;
+    m_started = true;
+    m_start_time = chrono::steady_clock::now();
+
+    auto& args = Application::instance().args();
+
+    m_udt_socket->init();
+    m_udt_socket->set_no_delay(args.no_delay());
+    m_udt_socket->connect(0, args.proxy_host(), args.proxy_port()); // TODO search for AF_INIT, v4
+    if (m_udt_socket->disposed()) return;  // failed, our death handler follows
+    m_udt_socket->on_connected(bind(&ProxyConnection::handle_udt_connected, this));
+
+    m_probe = m_prober.add(build_icmp_ttl_exceeded(m_udt_socket->local_port()));
+}
+
+void ProxyConnection::dispose() {
+    stop_probing();
+    m_udt_socket->dispose();
+}
+
+void ProxyConnection::on_death(AbstractSocket::DeathHandler handler) {
+    m_death_handler = handler;
+}
+
+void ProxyConnection::on_connected(AbstractSocket::ConnectedHandler handler) {
+    m_connected_handler = handler;
+}
+
+bool ProxyConnection::dead() {
+    return m_dead;
+}
+
+void ProxyConnection::die() {
+    m_dead = true;
+    stop_probing();
+    m_death_handler();
+}
+
+shared_ptr<UDTSocket> ProxyConnection::socket() {
+    return m_udt_socket;
+}
+
+asio::io_service::strand& ProxyConnection::strand() {
+    return m_strand;
+}
+
+// Build ttl exceeded message with an original icmp echo of id and sequence 0
+static vector<char> build_icmp_ttl_exceeded_template() {
+    auto& args = Application::instance().args();
+
+    vector<char> buffer;
+    vector<char> original_icmp;
+    args.get_icmp_echo(original_icmp, 0u, 0u);
+
+    if (args.is_ipv6()) {
+        buffer.resize(sizeof(icmp6_ttl_exceeded), 0);
+        auto icmp = reinterpret_cast<icmp6_ttl_exceeded*>(buffer.data());
+
+        icmp->icmp.icmp6_type = ICMP6_TIME_EXCEEDED;
+
+        *reinterpret_cast<char*>(&icmp->ip_header.ip6_flow) = 0x60;  // set ip version to 6
+        icmp->ip_header.ip6_plen = htons(sizeof(ip6_hdr) + sizeof(icmp6_hdr));
+        icmp->ip_header.ip6_hlim = 1u;
+        icmp->ip_header.ip6_nxt = IPPROTO_ICMPV6;
+        inet_pton(args.address_family(), args.proxy_host().to_string().c_str(), &icmp->ip_header.ip6_src);
+        inet_pton(args.address_family(), args.icmp_echo_destination().to_string().c_str(), &icmp->ip_header.ip6_dst);
+
+        memcpy(&icmp->original_icmp, original_icmp.data(), original_icmp.size());
+
+        // Note: icmp->icmp.icmp6_cksum is calculated for us by the OS
+    }
+    else {
+        buffer.resize(sizeof(icmp_ttl_exceeded), 0);
+        auto icmp = reinterpret_cast<icmp_ttl_exceeded*>(buffer.data());
+
+        icmp->icmp.type = ICMP_TIME_EXCEEDED;
+
+        icmp->ip_header.ip_hl = 5u;
+        icmp->ip_header.ip_v = 4u;
+        icmp->ip_header.ip_len = htons(sizeof(ip) + sizeof(icmphdr));
+        icmp->ip_header.ip_off = IP_DF;  // set don't fragment flag (is more realistic)
+        icmp->ip_header.ip_ttl = 1u;
+        icmp->ip_header.ip_p = IPPROTO_ICMP;
+        inet_pton(args.address_family(), args.proxy_host().to_string().c_str(), &icmp->ip_header.ip_src);
+        inet_pton(args.address_family(), args.icmp_echo_destination().to_string().c_str(), &icmp->ip_header.ip_dst);
+        icmp->ip_header.ip_sum = get_checksum(&icmp->ip_header, sizeof(ip));
+
+        memcpy(&icmp->original_icmp, original_icmp.data(), original_icmp.size());
+
+        icmp->icmp.checksum = get_checksum(buffer.data(), buffer.size());
+    }
+
+    return buffer;
+}
+
+/**
+ * Set word of the original icmp echo, updating the checksums that cover it
+ *
+ * outer_checksum: checksum of the ttl exceeded message, null if calculated by the OS
+ */
+static void set_original_icmp_word(u_int16_t& word, u_int16_t value, u_int16_t& inner_checksum, u_int16_t* outer_checksum) {
+    u_int16_t old_word = word;
+    u_int16_t old_inner_checksum = inner_checksum;
+    word = value;
+    inner_checksum = update_checksum(inner_checksum, old_word, value);
+    if (outer_checksum) {
+        *outer_checksum = update_checksum(*outer_checksum, old_word, value);
+        *outer_checksum = update_checksum(*outer_checksum, old_inner_checksum, inner_checksum);
+    }
+}
+
+vector<char> ProxyConnection::build_icmp_ttl_exceeded(u_int16_t client_port) {
+    // derive from a template, only the original icmp echo differs per connection
+    static const vector<char> icmp_ttl_exceeded_template = build_icmp_ttl_exceeded_template();
+    vector<char> buffer = icmp_ttl_exceeded_template;
+
+    if (Application::instance().args().is_ipv6()) {
+        auto icmp = reinterpret_cast<icmp6_ttl_exceeded*>(buffer.data());
+        auto& original_icmp = icmp->original_icmp;
+        set_original_icmp_word(original_icmp.icmp6_id, htons(m_flow_id->value()), original_icmp.icmp6_cksum, nullptr);
+        set_original_icmp_word(original_icmp.icmp6_seq, htons(client_port), original_icmp.icmp6_cksum, nullptr);
+    }
+    else {
+        auto icmp = reinterpret_cast<icmp_ttl_exceeded*>(buffer.data());
+        auto& original_icmp = icmp->original_icmp;
+        set_original_icmp_word(original_icmp.un.echo.id, htons(m_flow_id->value()), original_icmp.checksum, &icmp->icmp.checksum);
+        set_original_icmp_word(original_icmp.un.echo.sequence, htons(client_port), original_icmp.checksum, &icmp->icmp.checksum);
+    }
+
+    return buffer;
+}
+
+void ProxyConnection::stop_probing() {
+    if (m_probe) {
+        m_prober.cancel(m_probe);
+        m_probe = 0;
+    }
+}
+
+void ProxyConnection::handle_udt_connected() {
+    stop_probing();
+
+    auto connect_time = chrono::steady_clock::now() - m_start_time;
+    udt_connect_time.record(connect_time);
+    BOOST_LOG_TRIVIAL(info) << "Flow " << m_flow_id->value() << " connected in " << chrono::duration_cast<chrono::milliseconds>(connect_time).count() << " ms" << endl;
+
+    m_connected_handler();
+}
@@ -0,0 +1,97 @@
+/*
+ * Copyright (C) 2013 by Tim Diels
+ *
+ * This file is part of pwnat.
+ *
+ * pwnat is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * pwnat is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with pwnat.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <chrono>
+#include <memory>
+#include <vector>
+#include <boost/asio.hpp>
+#include <pwnat/UDTSocket.h>
+#include "ICMPProber.h"
+#include "FlowIdAllocator.h"
+
+class UDTServicePool;
+
+/**
+ * UDT connection to the proxy server, set up with pwnat ICMP trickery
+ *
+ * Has the ICMPProber send ICMP TTL exceeded messages to the proxy server until
+ * the UDT rendezvous connection is established. Must be used in the given
+ * strand.
+ */
+class ProxyConnection {
+public:
+    /**
+     * flow_id: Identifies which flow on the UDT connection to pick (allows reusing the UDT ports)
+     * death_handler: called when the connection dies
+     */
+    ProxyConnection(UDTServicePool& udt_services, ICMPProber& prober, boost::asio::io_service::strand strand, std::shared_ptr<FlowId> flow_id, AbstractSocket::DeathHandler death_handler);
+    ~ProxyConnection();
+
+    /**
+     * Start connecting, if not yet started
+     *
+     * Data can be sent onto the socket right away, it is sent once connected.
+     */
+    void start();
+
+    /**
+     * Replace the handler that's called when the connection dies
+     */
+    void on_death(AbstractSocket::DeathHandler);
+
+    /**
+     * Set handler that's called when the UDT connection is established
+     */
+    void on_connected(AbstractSocket::ConnectedHandler);
+
+    /**
+     * Whether the connection died
+     */
+    bool dead();
+
+    /**
+     * Stop punching and dispose the socket
+     */
+    void dispose();
+
+    std::shared_ptr<UDTSocket> socket();
+    boost::asio::io_service::strand& strand();
+
+private:
+    void die();
+    std::vector<char> build_icmp_ttl_exceeded(u_int16_t client_port);
+    void stop_probing();
+    void handle_udt_connected();
+
+private:
+    boost::asio::io_service::strand m_strand;
+    const std::shared_ptr<FlowId> m_flow_id;
+    AbstractSocket::DeathHandler m_death_handler;
+    AbstractSocket::ConnectedHandler m_connected_handler;
+    bool m_started;
+    bool m_dead;
+    std::chrono::steady_clock::time_point m_start_time;
+
+    ICMPProber& m_prober;
+    ICMPProber::ProbeId m_probe; // 0 if not probing
+
+    std::shared_ptr<UDTSocket> m_udt_socket;
+};
@@ -0,0 +1,160 @@
+/*
+ * Copyright (C) 2013 by Tim Diels
+ *
+ * This file is part of pwnat.
+ *
+ * pwnat is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * pwnat is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with pwnat.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "ProxyConnectionPool.h"
+#include <pwnat/udtservice/UDTServicePool.h>
+#include <pwnat/Application.h>
+#include <pwnat/Watchdog.h>
+#include <boost/log/trivial.hpp>
+
+#include <pwnat/namespaces.h>
+
+using boost::posix_time::ptime;
+using boost::posix_time::seconds;
+using boost::posix_time::microsec_clock;
+
+ProxyConnectionPool::ProxyConnectionPool(UDTServicePool& udt_services, ICMPProber& prober, asio::io_service& io_service, FlowIdAllocator& flow_ids) :
+    m_udt_services(udt_services),
+    m_prober(prober),
+    m_io_service(io_service),
+    m_flow_ids(flow_ids),
+    m_expiry_timer(io_service),
+    m_next_id(0),
+    m_target_size(Application::instance().args().pool_min_size())
+{
+    {
+        boost::lock_guard<boost::mutex> guard(m_lock);
+        fill();
+    }
+    start_expiry_timer();
+}
+
+ProxyConnectionPool::~ProxyConnectionPool() {
+    m_expiry_timer.cancel();
+}
+
+shared_ptr<ProxyConnection> ProxyConnectionPool::take() {
+    boost::lock_guard<boost::mutex> guard(m_lock);
+
+    if (m_entries.empty()) {
+        m_target_size = min(m_target_size + 1, Application::instance().args().pool_max_size());
+        fill();
+        return nullptr;
+    }
+
+    auto it = m_entries.begin();
+    for (auto candidate = m_entries.begin(); candidate != m_entries.end(); candidate++) {
+        if (candidate->second.connected) {
+            it = candidate;
+            break;
+        }
+    }
+
+    auto connection = it->second.connection;
+    m_entries.erase(it);
+    fill();
+    return connection;
+}
+
+// Note: m_lock must be held
+void ProxyConnectionPool::fill() {
+    while (m_entries.size() < m_target_size) {
+        u_int64_t id = m_next_id++;
+        asio::io_service::strand strand(m_io_service);
+        auto death_handler = bind(&ProxyConnectionPool::handle_death, this, id);
+
+        shared_ptr<ProxyConnection> connection;
+        try {
+            connection = make_shared<ProxyConnection>(m_udt_services, m_prober, strand, m_flow_ids.allocate(), death_handler);
+        }
+        catch (const exception& e) {
+            BOOST_LOG_TRIVIAL(error) << "Failed to create pooled connection: " << e.what() << endl;
+            return;
+        }
+
+        Entry entry = {connection, false, ptime()};
+        m_entries[id] = entry;
+
+        connection->on_connected(bind(&ProxyConnectionPool::handle_connected, this, id));
+        strand.post(Watchdog::watch(bind(&ProxyConnection::start, connection)));
+    }
+}
+
+void ProxyConnectionPool::handle_connected(u_int64_t id) {
+    boost::lock_guard<boost::mutex> guard(m_lock);
+    auto it = m_entries.find(id);
+    if (it != m_entries.end()) {
+        it->second.connected = true;
+        it->second.idle_since = microsec_clock::universal_time();
+    }
+}
+
+void ProxyConnectionPool::handle_death(u_int64_t id) {
+    BOOST_LOG_TRIVIAL(debug) << "Pooled connection died" << endl;
+    m_io_service.post(bind(&ProxyConnectionPool::remove, this, id));  // Note: we might be called with m_lock held
+}
+
+void ProxyConnectionPool::remove(u_int64_t id) {
+    boost::lock_guard<boost::mutex> guard(m_lock);
+    auto it = m_entries.find(id);
+    if (it != m_entries.end()) {
+        auto connection = it->second.connection;
+        m_entries.erase(it);
+        connection->strand().post(Watchdog::watch(bind(&ProxyConnection::dispose, connection)));
+        fill();
+    }
+}
+
+void ProxyConnectionPool::start_expiry_timer() {
+    m_expiry_timer.expires_from_now(seconds(1));
+    m_expiry_timer.async_wait(bind(&ProxyConnectionPool::handle_expiry_timer, this, asio::placeholders::error));
+}
+
+void ProxyConnectionPool::handle_expiry_timer(const boost::system::error_code& error) {
+    if (error) {
+        if (error.value() != asio::error::operation_aborted) {  // aborted = timer cancelled
+            BOOST_LOG_TRIVIAL(warning) << "Warning: Unexpected timer error: " << error.message() << endl;
+        }
+        return;
+    }
+
+    auto& args = Application::instance().args();
+    auto expiry_time = microsec_clock::universal_time() - seconds(args.pool_idle_timeout());
+
+    {
+        boost::lock_guard<boost::mutex> guard(m_lock);
+        for (auto it = m_entries.begin(); it != m_entries.end();) {
+            auto& entry = it->second;
+            if (entry.connected && entry.idle_since <= expiry_time) {
+                BOOST_LOG_TRIVIAL(debug) << "Closing idle pooled connection" << endl;
+                entry.connection->strand().post(Watchdog::watch(bind(&ProxyConnection::dispose, entry.connection)));
+                it = m_entries.erase(it);
+                if (m_target_size > args.pool_min_size()) {
+                    m_target_size--;
+                }
+            }
+            else {
+                it++;
+            }
+        }
+        fill();
+    }
+
+    start_expiry_timer();
+}
@@ -0,0 +1,83 @@
+/*
+ * Copyright (C) 2013 by Tim Diels
+ *
+ * This file is part of pwnat.
+ *
+ * pwnat is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * pwnat is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with pwnat.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <map>
+#include <memory>
+#include <boost/asio.hpp>
+#include <boost/thread.hpp>
+#include "ProxyConnection.h"
+
+class UDTServicePool;
+
+/**
+ * Pool of pre-warmed ProxyConnections, already punched and connected
+ *
+ * Keeps a target number of connections ready, which starts at the minimum size,
+ * grows with each take() that finds the pool empty, up to the maximum size,
+ * and shrinks back to the minimum as connections expire. Connections idle for
+ * longer than the idle timeout are closed and replaced if still needed, so
+ * they don't hold resources on the proxy server forever.
+ *
+ * Thread safe.
+ */
+class ProxyConnectionPool {
+public:
+    /**
+     * flow_ids: allocator shared with the other users of flow ids
+     */
+    ProxyConnectionPool(UDTServicePool&, ICMPProber&, boost::asio::io_service&, FlowIdAllocator& flow_ids);
+    ~ProxyConnectionPool();
+
+    /**
+     * Take a connection out of the pool, preferring established ones
+     *
+     * Returns nullptr if the pool is empty. The connection is started, its
+     * death handler must be replaced in its strand (see ProxyConnection::on_death).
+     */
+    std::shared_ptr<ProxyConnection> take();
+
+private:
+    struct Entry {
+        std::shared_ptr<ProxyConnection> connection;
+        bool connected;
+        boost::posix_time::ptime idle_since; // when it connected
+    };
+
+private:
+    void fill();
+    void start_expiry_timer();
+    void handle_expiry_timer(const boost::system::error_code& error);
+    void handle_connected(u_int64_t id);
+    void handle_death(u_int64_t id);
+    void remove(u_int64_t id);
+
+private:
+    UDTServicePool& m_udt_services;
+    ICMPProber& m_prober;
+    boost::asio::io_service& m_io_service;
+    FlowIdAllocator& m_flow_ids;
+    boost::asio::deadline_timer m_expiry_timer;
+
+    boost::mutex m_lock; // guards the members below
+    std::map<u_int64_t, Entry> m_entries;
+    u_int64_t m_next_id;
+    size_t m_target_size;
+};
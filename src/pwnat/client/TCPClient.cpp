@@ -19,136 +19,118 @@
 
 #include "TCPClient.h"
 #include <boost/bind.hpp>
-#include <pwnat/udtservice/UDTService.h>
-#include <pwnat/checksum.h>
+#include <pwnat/udtservice/UDTServicePool.h>
 #include <pwnat/Application.h>
+#include <pwnat/util.h>
+#include <pwnat/packet.h>
+#include <pwnat/StripedSocket.h>
+#include <pwnat/Watchdog.h>
+#include "Tunnel.h"
 #include <boost/log/trivial.hpp>
 
 #include <pwnat/namespaces.h>
 
-TCPClient::TCPClient(UDTService& udt_service, asio::ip::tcp::socket* tcp_socket, u_int16_t flow_id) :
-    m_udt_socket(make_shared<UDTSocket>(udt_service, bind(&TCPClient::die, this))),
-    m_tcp_socket(make_shared<TCPSocket>(shared_ptr<asio::ip::tcp::socket>(tcp_socket), bind(&TCPClient::die, this))), 
-    m_icmp_socket(tcp_socket->get_io_service(), asio::ip::icmp::endpoint(Application::instance().args().icmp_version(), 0)),
-    m_icmp_timer(tcp_socket->get_io_service())
+TCPClient::TCPClient(UDTServicePool& udt_services, ICMPProber& prober, asio::ip::tcp::socket* tcp_socket, shared_ptr<FlowId> flow_id) :
+    m_strand(tcp_socket->get_io_service()),
+    m_tcp_socket(make_shared<TCPSocket>(shared_ptr<asio::ip::tcp::socket>(tcp_socket), m_strand, bind(&TCPClient::die, this)))
 {
-    auto& args = Application::instance().args();
-
-    m_udt_socket->init();
-    send_udt_flow_init(args.remote_host(), args.remote_port()); // this must be the first data sent onto the socket
-    m_udt_socket->connect(0, args.proxy_host(), args.proxy_port()); // TODO search for AF_INIT, v4
-    m_udt_socket->on_connected(bind(&TCPClient::handle_udt_connected, this));
-
-    m_tcp_socket->init();
-
-    m_udt_socket->receive_data_from(*m_tcp_socket);
-    m_tcp_socket->receive_data_from(*m_udt_socket);
-
-    m_icmp_socket.connect(asio::ip::icmp::endpoint(args.proxy_host(), 0u));
-    build_icmp_ttl_exceeded(flow_id, m_udt_socket->local_port());
-    send_icmp_ttl_exceeded();
-    // TODO multiple TCPClients cause segfault in pwnat server
-}
+    // Note: the connections of a striped flow share its flow id
+    for (size_t i = 0; i < Application::instance().args().stripes(); i++) {
+        m_proxy_connections.push_back(make_shared<ProxyConnection>(udt_services, prober, m_strand, flow_id, bind(&TCPClient::die, this)));
+    }
 
-TCPClient::~TCPClient() {
-    BOOST_LOG_TRIVIAL(debug) << "TCPClient: Deallocated" << endl;
+    // start in our strand, so that no handler of ours can run before we've started
+    m_strand.post(Watchdog::watch(bind(&TCPClient::start, this)));
 }
 
-void TCPClient::die() {
-    m_udt_socket->dispose();
-    m_tcp_socket->dispose();
-    delete this;
+TCPClient::TCPClient(shared_ptr<ProxyConnection> proxy_connection, asio::ip::tcp::socket* tcp_socket) :
+    m_strand(proxy_connection->strand()),
+    m_tcp_socket(make_shared<TCPSocket>(shared_ptr<asio::ip::tcp::socket>(tcp_socket), m_strand, bind(&TCPClient::die, this))), 
+    m_proxy_connections(1, proxy_connection)
+{
+    m_strand.post(Watchdog::watch(bind(&TCPClient::start, this)));
 }
 
-void TCPClient::send_udt_flow_init(string remote_host, u_int16_t remote_port) {
-    u_int16_t size = sizeof(udt_flow_init) + remote_host.length();
-    vector<char> buffer(size);
-    udt_flow_init& flow_init = *reinterpret_cast<udt_flow_init*>(buffer.data());
-    flow_init.size = size;
-    flow_init.remote_port = remote_port;
-    memcpy(buffer.data() + sizeof(udt_flow_init), remote_host.data(), remote_host.length());
-    m_udt_socket->send(buffer.data(), buffer.size());
+TCPClient::TCPClient(shared_ptr<Tunnel> tunnel, asio::ip::tcp::socket* tcp_socket) :
+    m_strand(tunnel->strand()),
+    m_tcp_socket(make_shared<TCPSocket>(shared_ptr<asio::ip::tcp::socket>(tcp_socket), m_strand, bind(&TCPClient::die, this))), 
+    m_tunnel(tunnel)
+{
+    m_strand.post(Watchdog::watch(bind(&TCPClient::start, this)));
 }
 
-void TCPClient::build_icmp_ttl_exceeded(u_int16_t flow_id, u_int16_t client_port) {
+void TCPClient::start() {
     auto& args = Application::instance().args();
 
-    vector<char> original_icmp;
-    args.get_icmp_echo(original_icmp, flow_id, client_port);
-
-    if (args.is_ipv6()) {
-        m_icmp_ttl_exceeded.resize(sizeof(icmp6_ttl_exceeded), 0);
-        auto icmp = reinterpret_cast<icmp6_ttl_exceeded*>(m_icmp_ttl_exceeded.data());
-
-        icmp->icmp.icmp6_type = ICMP6_TIME_EXCEEDED;
-
-        *reinterpret_cast<char*>(&icmp->ip_header.ip6_flow) = 0x60;  // set ip version to 6
-        icmp->ip_header.ip6_plen = htons(sizeof(ip6_hdr) + sizeof(icmp6_hdr));
-        icmp->ip_header.ip6_hlim = 1u;
-        icmp->ip_header.ip6_nxt = IPPROTO_ICMPV6;
-        inet_pton(args.address_family(), args.proxy_host().to_string().c_str(), &icmp->ip_header.ip6_src);
-        inet_pton(args.address_family(), args.icmp_echo_destination().to_string().c_str(), &icmp->ip_header.ip6_dst);
+    try {
+        if (m_tunnel) {
+            m_proxy_socket = m_tunnel->open_stream(bind(&TCPClient::die, this));
+            if (!m_proxy_socket) {
+                BOOST_LOG_TRIVIAL(error) << "Failed to start client: tunnel is dead" << endl;
+                die();
+                return;
+            }
+            m_proxy_socket->init();
+        }
+        else {
+            auto& proxy_connection = *m_proxy_connections.front();
+            proxy_connection.on_death(bind(&TCPClient::die, this));
+            if (proxy_connection.dead()) {
+                BOOST_LOG_TRIVIAL(error) << "Failed to start client: connection to proxy died" << endl;
+                die();
+                return;
+            }
+
+            if (m_proxy_connections.size() == 1) {
+                proxy_connection.start();
+                m_proxy_socket = proxy_connection.socket();
+            }
+            else {
+                start_striped();
+            }
+        }
+        send_udt_flow_init(*m_proxy_socket, args.remote_host(), args.remote_port()); // this must be the first data sent onto the socket
 
-        memcpy(&icmp->original_icmp, original_icmp.data(), original_icmp.size());
+        m_tcp_socket->init();
 
-        // Note: icmp->icmp.icmp6_cksum is calculated for us by the OS
+        m_proxy_socket->receive_data_from(*m_tcp_socket);
+        m_tcp_socket->receive_data_from(*m_proxy_socket);
     }
-    else {
-        m_icmp_ttl_exceeded.resize(sizeof(icmp_ttl_exceeded), 0);
-        auto icmp = reinterpret_cast<icmp_ttl_exceeded*>(m_icmp_ttl_exceeded.data());
-
-        icmp->icmp.type = ICMP_TIME_EXCEEDED;
-
-        icmp->ip_header.ip_hl = 5u;
-        icmp->ip_header.ip_v = 4u;
-        icmp->ip_header.ip_len = htons(sizeof(ip) + sizeof(icmphdr));
-        icmp->ip_header.ip_off = IP_DF;  // set don't fragment flag (is more realistic)
-        icmp->ip_header.ip_ttl = 1u;
-        icmp->ip_header.ip_p = IPPROTO_ICMP;
-        inet_pton(args.address_family(), args.proxy_host().to_string().c_str(), &icmp->ip_header.ip_src);
-        inet_pton(args.address_family(), args.icmp_echo_destination().to_string().c_str(), &icmp->ip_header.ip_dst);
-        icmp->ip_header.ip_sum = htons(get_checksum(reinterpret_cast<uint16_t*>(&icmp->ip_header), sizeof(ip)));
-
-        memcpy(&icmp->original_icmp, original_icmp.data(), original_icmp.size());
-
-        icmp->icmp.checksum = htons(get_checksum(reinterpret_cast<uint16_t*>(m_icmp_ttl_exceeded.data()), m_icmp_ttl_exceeded.size()));
+    catch (const exception& e) {
+        BOOST_LOG_TRIVIAL(error) << "Failed to start client: " << e.what() << endl;
+        die();
     }
 }
 
-void TCPClient::send_icmp_ttl_exceeded() {
-    // send
-    {
-        auto buffer = asio::buffer(m_icmp_ttl_exceeded);
-        auto callback = bind(&TCPClient::handle_send, this, asio::placeholders::error);
-        m_icmp_socket.async_send(buffer, callback);
-    }
+void TCPClient::start_striped() {
+    udt_stripe_init stripe_init;
+    stripe_init.zero = 0;
+    stripe_init.stripe_count = m_proxy_connections.size();
 
-    // set timer
-    {
-        m_icmp_timer.expires_from_now(boost::posix_time::seconds(5));
-        auto callback = bind(&TCPClient::handle_icmp_timer_expired, this, asio::placeholders::error);
-        m_icmp_timer.async_wait(callback);
+    vector<shared_ptr<AbstractSocket>> stripes;
+    for (auto& proxy_connection : m_proxy_connections) {
+        proxy_connection->start();
+        proxy_connection->socket()->send(reinterpret_cast<const char*>(&stripe_init), sizeof(udt_stripe_init)); // this must be the first data sent onto the socket
+        stripes.push_back(proxy_connection->socket());
     }
-}
 
-void TCPClient::handle_icmp_timer_expired(const boost::system::error_code& error) {
-    if (error) {
-        if (error.value() != asio::error::operation_aborted) {  // aborted = timer cancelled
-            BOOST_LOG_TRIVIAL(warning) << "Unexpected timer error: " << error.message() << endl;
-            die();
-        }
-    }
-    else {
-        send_icmp_ttl_exceeded();
-    } 
+    auto striped_socket = make_shared<StripedSocket>(stripes, m_strand, bind(&TCPClient::die, this));
+    striped_socket->start();
+    striped_socket->init();
+    m_proxy_socket = striped_socket;
 }
 
-void TCPClient::handle_send(const boost::system::error_code& error) {
-    if (error) {
-        BOOST_LOG_TRIVIAL(warning) << "Warning: send icmp ttl exceeded failed: " << error.message() << endl;
-    }
+TCPClient::~TCPClient() {
+    BOOST_LOG_TRIVIAL(debug) << "TCPClient: Deallocated" << endl;
 }
 
-void TCPClient::handle_udt_connected() {
-    m_icmp_timer.cancel();
+void TCPClient::die() {
+    for (auto& proxy_connection : m_proxy_connections) {
+        proxy_connection->dispose();
+    }
+    if (m_proxy_socket) {
+        m_proxy_socket->dispose();
+    }
+    m_tcp_socket->dispose();
+    delete this;
 }
@@ -21,34 +21,51 @@
 
 #include <memory>
 #include <boost/asio.hpp>
-#include <pwnat/UDTSocket.h>
 #include <pwnat/Socket.h>
-#include <pwnat/packet.h>
+#include "ProxyConnection.h"
 
-class UDTService;
+class UDTServicePool;
+class Tunnel;
 
+/**
+ * A tunnel from a local TCP client to the proxy server
+ *
+ * Either has UDT connections of its own (one, or --stripes striped ones), or a
+ * stream in a multiplexed Tunnel.
+ *
+ * All its handlers run in its own strand, or in that of its Tunnel. Deletes
+ * itself when it dies.
+ */
 class TCPClient {
 public:
     /**
+     * Connect through UDT connections of our own
+     *
      * flow_id: Identifies which flow on the UDT connection to pick (allows reusing the UDT ports)
      */
-    TCPClient(UDTService& udt_service, boost::asio::ip::tcp::socket* tcp_socket, u_int16_t flow_id);
+    TCPClient(UDTServicePool& udt_services, ICMPProber& prober, boost::asio::ip::tcp::socket* tcp_socket, std::shared_ptr<FlowId> flow_id);
+
+    /**
+     * Connect through a connection taken from a ProxyConnectionPool
+     */
+    TCPClient(std::shared_ptr<ProxyConnection> proxy_connection, boost::asio::ip::tcp::socket* tcp_socket);
+
+    /**
+     * Connect through a stream of tunnel
+     */
+    TCPClient(std::shared_ptr<Tunnel> tunnel, boost::asio::ip::tcp::socket* tcp_socket);
+
     ~TCPClient();
 
 private:
+    void start();
+    void start_striped();
     void die();
-    void send_udt_flow_init(std::string remote_host, u_int16_t remote_port);
-    void build_icmp_ttl_exceeded(u_int16_t flow_id, u_int16_t client_port);
-    void send_icmp_ttl_exceeded();
-    void handle_send(const boost::system::error_code& error);
-    void handle_icmp_timer_expired(const boost::system::error_code& error);
-    void handle_udt_connected();
 
 private:
-    std::shared_ptr<UDTSocket> m_udt_socket;
+    boost::asio::io_service::strand m_strand;
     std::shared_ptr<TCPSocket> m_tcp_socket;
-
-    boost::asio::ip::icmp::socket m_icmp_socket;
-    boost::asio::deadline_timer m_icmp_timer;
-    std::vector<char> m_icmp_ttl_exceeded;
+    std::shared_ptr<AbstractSocket> m_proxy_socket; // socket to the proxy server
+    std::vector<std::shared_ptr<ProxyConnection>> m_proxy_connections; // empty if we use a tunnel
+    std::shared_ptr<Tunnel> m_tunnel;
 };
@@ -19,19 +19,35 @@
 
 #include "TCPServer.h"
 #include "TCPClient.h"
+#include "Tunnel.h"
+#include "ProxyConnectionPool.h"
+#include "ICMPProber.h"
+#include "FlowIdAllocator.h"
+#include <pwnat/metrics/Counter.h>
 #include <boost/log/trivial.hpp>
 
 #include <pwnat/namespaces.h>
 
+static Counter tcp_accepted("pwnat_tcp_accepted_total", "TCP connections accepted by the client");
+
 TCPServer::TCPServer(ProgramArgs& args) :
     Application(args),
     m_acceptor(m_io_service, asio::ip::tcp::endpoint(args.bind_address(), args.local_port())),
-    m_next_flow_id(1u)
+    m_flow_ids(make_shared<FlowIdAllocator>()),
+    m_tunnels(args.tunnels()),
+    m_next_tunnel(0)
 {
-    args.resolve_proxy_host(m_io_service);
+    args.resolve_proxy_host(m_resolver);
+    m_prober.reset(new ICMPProber(m_io_service));
+    if (m_tunnels.empty() && args.stripes() == 1 && args.pool_max_size() > 0) {
+        m_connection_pool.reset(new ProxyConnectionPool(m_udt_services, *m_prober, m_io_service, *m_flow_ids));
+    }
     accept();
 }
 
+TCPServer::~TCPServer() {
+}
+
 void TCPServer::accept() {
     auto new_socket = new asio::ip::tcp::socket(m_acceptor.get_io_service());
     auto callback = bind(&TCPServer::handle_accept, this, asio::placeholders::error, new_socket);
@@ -43,9 +59,20 @@ void TCPServer::handle_accept(const boost::system::error_code& error, asio::ip::
         BOOST_LOG_TRIVIAL(error) << "TCP Server: accept error: " << error.message() << endl;
     }
     else {
+        tcp_accepted.add();
         BOOST_LOG_TRIVIAL(info) << "New tcp client at port " << tcp_socket->remote_endpoint().port() << endl;
         try {
-            new TCPClient(m_udt_service, tcp_socket, m_next_flow_id++);  // Note: ownership of socket transferred to TCPClient instance
+            // Note: ownership of socket transferred to TCPClient instance
+            shared_ptr<ProxyConnection> proxy_connection;
+            if (!m_tunnels.empty()) {
+                new TCPClient(get_tunnel(), tcp_socket);
+            }
+            else if (m_connection_pool && (proxy_connection = m_connection_pool->take())) {
+                new TCPClient(proxy_connection, tcp_socket);
+            }
+            else {
+                new TCPClient(m_udt_services, *m_prober, tcp_socket, m_flow_ids->allocate());
+            }
         }
         catch (const exception& e) {
             BOOST_LOG_TRIVIAL(error) << "Failed to create client: " << e.what() << endl;
@@ -57,3 +84,12 @@ void TCPServer::handle_accept(const boost::system::error_code& error, asio::ip::
 
     accept();
 }
+
+shared_ptr<Tunnel> TCPServer::get_tunnel() {
+    auto& tunnel = m_tunnels.at(m_next_tunnel);
+    m_next_tunnel = (m_next_tunnel + 1) % m_tunnels.size();
+    if (!tunnel || tunnel->dead()) {
+        tunnel = make_shared<Tunnel>(m_udt_services, *m_prober, m_io_service, m_flow_ids->allocate());
+    }
+    return tunnel;
+}
@@ -19,18 +19,35 @@
 
 #pragma once
 
+#include <memory>
+#include <vector>
 #include <pwnat/Application.h>
 
+class Tunnel;
+class ProxyConnectionPool;
+class ICMPProber;
+class FlowIdAllocator;
+
 class TCPServer : public Application {
 public:
     TCPServer(ProgramArgs&);
+    ~TCPServer();
 
 private:
     void accept();
     void handle_accept(const boost::system::error_code& error, boost::asio::ip::tcp::socket* tcp_socket);
 
+    /**
+     * Get next tunnel round robin, replaces dead tunnels
+     */
+    std::shared_ptr<Tunnel> get_tunnel();
+
 private:
     boost::asio::ip::tcp::acceptor m_acceptor;
-    u_int16_t m_next_flow_id;
+    std::shared_ptr<FlowIdAllocator> m_flow_ids;
+    std::unique_ptr<ICMPProber> m_prober;
+    std::unique_ptr<ProxyConnectionPool> m_connection_pool; // null if not pooling
+    std::vector<std::shared_ptr<Tunnel>> m_tunnels; // empty if not multiplexing
+    size_t m_next_tunnel;
 };
 
@@ -0,0 +1,80 @@
+/*
+ * Copyright (C) 2013 by Tim Diels
+ *
+ * This file is part of pwnat.
+ *
+ * pwnat is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * pwnat is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with pwnat.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "Tunnel.h"
+#include <pwnat/udtservice/UDTServicePool.h>
+#include <pwnat/packet.h>
+#include <pwnat/util.h>
+#include <pwnat/Watchdog.h>
+#include <boost/log/trivial.hpp>
+
+#include <pwnat/namespaces.h>
+
+Tunnel::Tunnel(UDTServicePool& udt_services, ICMPProber& prober, asio::io_service& io_service, shared_ptr<FlowId> flow_id) :
+    m_strand(io_service),
+    m_connection(udt_services, prober, m_strand, flow_id, bind(&Tunnel::die, this)),
+    m_dead(false)
+{
+    // start in our strand, so that no handler of ours can run before we've started
+    m_strand.post(Watchdog::watch(bind(&Tunnel::start, this)));
+}
+
+Tunnel::~Tunnel() {
+    m_multiplexer.reset();
+    m_connection.dispose();
+    BOOST_LOG_TRIVIAL(debug) << "Tunnel: Deallocated" << endl;
+}
+
+void Tunnel::start() {
+    try {
+        m_connection.start();
+        send_udt_flow_init(*m_connection.socket(), "", udt_flow_multiplexed); // this must be the first data sent onto the socket
+        m_multiplexer.reset(new Multiplexer(m_connection.socket(), m_strand));
+        m_multiplexer->start();
+    }
+    catch (const exception& e) {
+        BOOST_LOG_TRIVIAL(error) << "Failed to start tunnel: " << e.what() << endl;
+        die();
+    }
+}
+
+void Tunnel::die() {
+    if (m_dead) return;
+    m_dead = true;
+    auto self = shared_from_this(); // closing the streams may release the last other reference to us
+
+    BOOST_LOG_TRIVIAL(info) << "Tunnel died, closing its streams" << endl;
+    m_multiplexer.reset();
+    m_connection.dispose();
+}
+
+shared_ptr<StreamSocket> Tunnel::open_stream(AbstractSocket::DeathHandler death_handler) {
+    if (m_dead || !m_multiplexer) {
+        return nullptr;
+    }
+    return m_multiplexer->open_stream(death_handler);
+}
+
+bool Tunnel::dead() {
+    return m_dead;
+}
+
+asio::io_service::strand& Tunnel::strand() {
+    return m_strand;
+}
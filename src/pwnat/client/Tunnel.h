@@ -0,0 +1,67 @@
+/*
+ * Copyright (C) 2013 by Tim Diels
+ *
+ * This file is part of pwnat.
+ *
+ * pwnat is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * pwnat is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with pwnat.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <boost/asio.hpp>
+#include <pwnat/multiplexer/Multiplexer.h>
+#include "ProxyConnection.h"
+
+class UDTServicePool;
+
+/**
+ * Multiplexed UDT connection to the proxy server, carries the streams of many TCPClients
+ *
+ * The streams share the strand of the tunnel. When the connection dies, all
+ * its streams are closed.
+ */
+class Tunnel : public std::enable_shared_from_this<Tunnel> {
+public:
+    /**
+     * Must be owned by a shared_ptr
+     */
+    Tunnel(UDTServicePool& udt_services, ICMPProber& prober, boost::asio::io_service& io_service, std::shared_ptr<FlowId> flow_id);
+    ~Tunnel();
+
+    /**
+     * Open a new stream
+     *
+     * Must be called in strand(). Returns nullptr if the tunnel is dead.
+     */
+    std::shared_ptr<StreamSocket> open_stream(AbstractSocket::DeathHandler);
+
+    /**
+     * Whether the connection died. Thread safe
+     */
+    bool dead();
+
+    boost::asio::io_service::strand& strand();
+
+private:
+    void start();
+    void die();
+
+private:
+    boost::asio::io_service::strand m_strand;
+    ProxyConnection m_connection;
+    std::unique_ptr<Multiplexer> m_multiplexer;
+    std::atomic<bool> m_dead;
+};
@@ -17,11 +17,26 @@
  * along with pwnat.  If not, see <http://www.gnu.org/licenses/>.
  */
 
-#pragma once
+#include "Counter.h"
 
-#include <stdexcept>
+#include <pwnat/namespaces.h>
 
-class SocketException : public std::runtime_error {
-public:
-    SocketException(std::string what) : std::runtime_error(what) {}
-};
+Counter::Counter(string name, string help, Type type) :
+    m_name(name),
+    m_help(help),
+    m_type(type)
+{
+    m_index = MetricsRegistry::instance().add(*this);
+}
+
+const string& Counter::name() const {
+    return m_name;
+}
+
+const string& Counter::help() const {
+    return m_help;
+}
+
+Counter::Type Counter::type() const {
+    return m_type;
+}
@@ -0,0 +1,58 @@
+/*
+ * Copyright (C) 2013 by Tim Diels
+ *
+ * This file is part of pwnat.
+ *
+ * pwnat is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * pwnat is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with pwnat.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <string>
+#include <boost/noncopyable.hpp>
+#include "MetricsRegistry.h"
+
+/**
+ * Process wide metric, registered with MetricsRegistry
+ *
+ * Meant to be a static object. Adding is cheap, see MetricsRegistry. Thread safe
+ */
+class Counter : public boost::noncopyable {
+public:
+    enum Type {
+        COUNTER, // only goes up
+        GAUGE // goes up and down
+    };
+
+public:
+    /**
+     * name: Prometheus metric name, optionally with labels, e.g. pwnat_bytes_sent_total{transport="tcp"}
+     */
+    Counter(std::string name, std::string help, Type type = COUNTER);
+
+    void add(int64_t value = 1) {
+        auto& shard_value = MetricsRegistry::instance().shard()[m_index];
+        shard_value.store(shard_value.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);  // Note: only this thread writes to its shard
+    }
+
+    const std::string& name() const;
+    const std::string& help() const;
+    Type type() const;
+
+private:
+    const std::string m_name;
+    const std::string m_help;
+    const Type m_type;
+    size_t m_index;
+};
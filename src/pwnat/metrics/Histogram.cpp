@@ -0,0 +1,110 @@
+/*
+ * Copyright (C) 2013 by Tim Diels
+ *
+ * This file is part of pwnat.
+ *
+ * pwnat is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * pwnat is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with pwnat.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "Histogram.h"
+#include "MetricsRegistry.h"
+
+#include <pwnat/namespaces.h>
+
+const size_t Histogram::sub_buckets;
+const size_t Histogram::bucket_count;
+
+Histogram::Histogram(string name, string labels, string help) :
+    m_name(name),
+    m_labels(labels),
+    m_help(help),
+    m_count(0),
+    m_sum(0)
+{
+    for (auto& bucket : m_buckets) {
+        bucket.store(0, memory_order_relaxed);
+    }
+    MetricsRegistry::instance().add(*this);
+}
+
+void Histogram::record(chrono::steady_clock::duration duration) {
+    auto value = chrono::duration_cast<chrono::microseconds>(duration).count();
+    u_int64_t microseconds = value < 0 ? 0 : value;
+    m_buckets[get_bucket(microseconds)].fetch_add(1, memory_order_relaxed);
+    m_count.fetch_add(1, memory_order_relaxed);
+    m_sum.fetch_add(microseconds, memory_order_relaxed);
+}
+
+u_int64_t Histogram::quantile(double q) const {
+    // Note: counts may be a little out of sync with m_count, as nothing is locked
+    u_int64_t total = 0;
+    for (auto& bucket : m_buckets) {
+        total += bucket.load(memory_order_relaxed);
+    }
+    if (total == 0) {
+        return 0;
+    }
+
+    u_int64_t rank = static_cast<u_int64_t>(q * total);
+    u_int64_t seen = 0;
+    for (size_t i = 0; i < bucket_count; i++) {
+        seen += m_buckets[i].load(memory_order_relaxed);
+        if (seen > rank) {
+            return get_bucket_middle(i);
+        }
+    }
+    return get_bucket_middle(bucket_count - 1);
+}
+
+u_int64_t Histogram::count() const {
+    return m_count.load(memory_order_relaxed);
+}
+
+u_int64_t Histogram::sum() const {
+    return m_sum.load(memory_order_relaxed);
+}
+
+const string& Histogram::name() const {
+    return m_name;
+}
+
+const string& Histogram::labels() const {
+    return m_labels;
+}
+
+const string& Histogram::help() const {
+    return m_help;
+}
+
+size_t Histogram::get_bucket(u_int64_t value) {
+    static_assert(sub_buckets == 8, "get_bucket assumes 3 bits of sub bucket");
+    if (value < sub_buckets) {
+        return value;
+    }
+
+    size_t exponent = 63 - __builtin_clzll(value);  // >= log2(sub_buckets)
+    size_t shift = exponent - 3;  // Note: sub_buckets == 1 << 3
+    size_t sub_bucket = (value >> shift) - sub_buckets;
+    return sub_buckets + shift * sub_buckets + sub_bucket;
+}
+
+u_int64_t Histogram::get_bucket_middle(size_t bucket) {
+    if (bucket < sub_buckets) {
+        return bucket;
+    }
+
+    size_t shift = (bucket - sub_buckets) / sub_buckets;
+    u_int64_t lower = static_cast<u_int64_t>(sub_buckets + (bucket - sub_buckets) % sub_buckets) << shift;
+    return lower + (static_cast<u_int64_t>(1) << shift) / 2;
+}
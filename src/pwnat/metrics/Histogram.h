@@ -0,0 +1,73 @@
+/*
+ * Copyright (C) 2013 by Tim Diels
+ *
+ * This file is part of pwnat.
+ *
+ * pwnat is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * pwnat is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with pwnat.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <boost/noncopyable.hpp>
+
+/**
+ * Lock free histogram of durations, registered with MetricsRegistry
+ *
+ * Log bucketed like HdrHistogram: each power of 2 of microseconds is split
+ * into sub_buckets linear buckets, so quantiles are within 1/sub_buckets of
+ * the actual value.
+ *
+ * Meant to be a static object. Thread safe
+ */
+class Histogram : public boost::noncopyable {
+public:
+    static const size_t sub_buckets = 8;
+    static const size_t bucket_count = sub_buckets + 61 * sub_buckets; // exact below sub_buckets, then per power of 2
+
+public:
+    /**
+     * name: Prometheus metric name, exposed as a summary in seconds
+     * labels: Prometheus labels without braces, e.g. stage="resolve", may be empty
+     */
+    Histogram(std::string name, std::string labels, std::string help);
+
+    void record(std::chrono::steady_clock::duration duration);
+
+    /**
+     * Get approximate value (in microseconds) below which fraction q of the recorded values are
+     */
+    u_int64_t quantile(double q) const;
+
+    u_int64_t count() const;
+    u_int64_t sum() const; // in microseconds
+
+    const std::string& name() const;
+    const std::string& labels() const;
+    const std::string& help() const;
+
+private:
+    static size_t get_bucket(u_int64_t value);
+    static u_int64_t get_bucket_middle(size_t bucket);
+
+private:
+    const std::string m_name;
+    const std::string m_labels;
+    const std::string m_help;
+    std::atomic<u_int64_t> m_buckets[bucket_count];
+    std::atomic<u_int64_t> m_count;
+    std::atomic<u_int64_t> m_sum;
+};
@@ -0,0 +1,120 @@
+/*
+ * Copyright (C) 2013 by Tim Diels
+ *
+ * This file is part of pwnat.
+ *
+ * pwnat is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * pwnat is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with pwnat.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "MetricsRegistry.h"
+#include "Counter.h"
+#include "Histogram.h"
+#include <algorithm>
+#include <cassert>
+#include <sstream>
+
+#include <pwnat/namespaces.h>
+
+const size_t MetricsRegistry::max_counters;
+thread_local atomic<int64_t>* MetricsRegistry::t_shard = nullptr;
+
+MetricsRegistry::MetricsRegistry() {
+}
+
+MetricsRegistry& MetricsRegistry::instance() {
+    static MetricsRegistry registry;  // Note: constructed on first use, Counters are static too
+    return registry;
+}
+
+size_t MetricsRegistry::add(Counter& counter) {
+    boost::lock_guard<boost::mutex> guard(m_lock);
+    assert(m_counters.size() < max_counters);
+    m_counters.push_back(&counter);
+    return m_counters.size() - 1;
+}
+
+void MetricsRegistry::add(Histogram& histogram) {
+    boost::lock_guard<boost::mutex> guard(m_lock);
+    m_histograms.push_back(&histogram);
+}
+
+atomic<int64_t>* MetricsRegistry::new_shard() {
+    auto shard = new atomic<int64_t>[max_counters];  // Note: never freed, see class doc
+    for (size_t i = 0; i < max_counters; i++) {
+        shard[i].store(0, memory_order_relaxed);
+    }
+
+    boost::lock_guard<boost::mutex> guard(m_lock);
+    m_shards.push_back(shard);
+    return shard;
+}
+
+// Note: m_lock must be held
+int64_t MetricsRegistry::sum(size_t index) {
+    int64_t sum = 0;
+    for (auto shard : m_shards) {
+        sum += shard[index].load(memory_order_relaxed);
+    }
+    return sum;
+}
+
+string MetricsRegistry::format() {
+    boost::lock_guard<boost::mutex> guard(m_lock);
+
+    vector<size_t> indices(m_counters.size());
+    for (size_t i = 0; i < indices.size(); i++) {
+        indices[i] = i;
+    }
+    sort(indices.begin(), indices.end(), [this](size_t a, size_t b) {
+        return m_counters.at(a)->name() < m_counters.at(b)->name();
+    });
+
+    // Note: counters of the same family (name without labels) are adjacent after sorting
+    ostringstream out;
+    string family;
+    for (auto index : indices) {
+        auto& counter = *m_counters.at(index);
+        string counter_family = counter.name().substr(0, counter.name().find('{'));
+        if (counter_family != family) {
+            family = counter_family;
+            out << "# HELP " << family << " " << counter.help() << "\n";
+            out << "# TYPE " << family << " " << (counter.type() == Counter::GAUGE ? "gauge" : "counter") << "\n";
+        }
+        out << counter.name() << " " << sum(index) << "\n";
+    }
+
+    // histograms, as summaries in seconds
+    auto histograms = m_histograms;
+    sort(histograms.begin(), histograms.end(), [](Histogram* a, Histogram* b) {
+        return make_pair(a->name(), a->labels()) < make_pair(b->name(), b->labels());
+    });
+
+    family.clear();
+    for (auto histogram : histograms) {
+        if (histogram->name() != family) {
+            family = histogram->name();
+            out << "# HELP " << family << " " << histogram->help() << "\n";
+            out << "# TYPE " << family << " summary\n";
+        }
+
+        string labels = histogram->labels().empty() ? "" : histogram->labels() + ",";
+        for (double q : {0.5, 0.99, 0.999}) {
+            out << family << "{" << labels << "quantile=\"" << q << "\"} " << histogram->quantile(q) / 1e6 << "\n";
+        }
+        string suffix_labels = histogram->labels().empty() ? "" : "{" + histogram->labels() + "}";
+        out << family << "_sum" << suffix_labels << " " << histogram->sum() / 1e6 << "\n";
+        out << family << "_count" << suffix_labels << " " << histogram->count() << "\n";
+    }
+    return out.str();
+}
@@ -0,0 +1,80 @@
+/*
+ * Copyright (C) 2013 by Tim Diels
+ *
+ * This file is part of pwnat.
+ *
+ * pwnat is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * pwnat is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with pwnat.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <string>
+#include <vector>
+#include <boost/thread.hpp>
+
+class Counter;
+class Histogram;
+
+/**
+ * Process wide registry of Counters and Histograms
+ *
+ * Each thread adds to the counters in a shard of its own, without
+ * synchronisation. The shards are only summed when formatting. Shards of
+ * threads that have exited are kept, so their counts aren't lost.
+ *
+ * Thread safe.
+ */
+class MetricsRegistry {
+public:
+    static const size_t max_counters = 128;
+
+public:
+    static MetricsRegistry& instance();
+
+    /**
+     * Register counter, returns its index into the shards
+     */
+    size_t add(Counter& counter);
+
+    void add(Histogram& histogram);
+
+    /**
+     * Get the shard of the calling thread
+     */
+    std::atomic<int64_t>* shard() {
+        if (!t_shard) {
+            t_shard = new_shard();
+        }
+        return t_shard;
+    }
+
+    /**
+     * Get all counters in Prometheus text format
+     */
+    std::string format();
+
+private:
+    MetricsRegistry();
+    std::atomic<int64_t>* new_shard();
+    int64_t sum(size_t index);
+
+private:
+    static thread_local std::atomic<int64_t>* t_shard;
+
+    boost::mutex m_lock; // guards the members below
+    std::vector<Counter*> m_counters; // by index
+    std::vector<Histogram*> m_histograms;
+    std::vector<std::atomic<int64_t>*> m_shards;
+};
@@ -0,0 +1,66 @@
+/*
+ * Copyright (C) 2013 by Tim Diels
+ *
+ * This file is part of pwnat.
+ *
+ * pwnat is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * pwnat is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with pwnat.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "MetricsServer.h"
+#include "MetricsRegistry.h"
+#include <boost/bind.hpp>
+#include <boost/log/trivial.hpp>
+
+#include <pwnat/namespaces.h>
+
+using asio::ip::tcp;
+
+MetricsServer::MetricsServer(asio::io_service& io_service, u_int16_t port) :
+    m_acceptor(io_service, tcp::endpoint(asio::ip::address_v4::loopback(), port))
+{
+    BOOST_LOG_TRIVIAL(info) << "Serving metrics at http://localhost:" << port << "/metrics" << endl;
+    accept();
+}
+
+void MetricsServer::accept() {
+    auto socket = make_shared<tcp::socket>(m_acceptor.get_io_service());
+    m_acceptor.async_accept(*socket, bind(&MetricsServer::handle_accept, this, asio::placeholders::error, socket));
+}
+
+void MetricsServer::handle_accept(const boost::system::error_code& error, shared_ptr<tcp::socket> socket) {
+    if (error) {
+        BOOST_LOG_TRIVIAL(warning) << "Warning: metrics server accept error: " << error.message() << endl;
+    }
+    else {
+        // read the request, whatever it is, then respond
+        auto request = make_shared<asio::streambuf>(64 * 1024);  // Note: requests are tiny, limit what a client can make us buffer
+        asio::async_read_until(*socket, *request, "\r\n\r\n", [socket, request](const boost::system::error_code& error, size_t) {
+            if (error) return;
+
+            string body = MetricsRegistry::instance().format();
+            ostringstream header;
+            header << "HTTP/1.0 200 OK\r\n"
+                   << "Content-Type: text/plain; version=0.0.4\r\n"
+                   << "Content-Length: " << body.size() << "\r\n"
+                   << "Connection: close\r\n\r\n";
+            auto response = make_shared<string>(header.str() + body);
+            asio::async_write(*socket, asio::buffer(*response), [socket, response](const boost::system::error_code&, size_t) {
+                boost::system::error_code ignored;
+                socket->shutdown(tcp::socket::shutdown_both, ignored);
+            });
+        });
+    }
+
+    accept();
+}
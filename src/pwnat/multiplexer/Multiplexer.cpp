@@ -0,0 +1,158 @@
+/*
+ * Copyright (C) 2013 by Tim Diels
+ *
+ * This file is part of pwnat.
+ *
+ * pwnat is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * pwnat is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with pwnat.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "Multiplexer.h"
+#include <cstring>
+#include <sstream>
+#include <boost/log/trivial.hpp>
+
+#include <pwnat/namespaces.h>
+
+Multiplexer::Multiplexer(shared_ptr<AbstractSocket> socket, asio::io_service::strand strand, OpenHandler open_handler) :
+    m_socket(socket),
+    m_strand(strand),
+    m_open_handler(open_handler),
+    m_next_stream_id(1u)
+{
+}
+
+Multiplexer::~Multiplexer() {
+    close_streams("tunnel closed");
+}
+
+shared_ptr<StreamSocket> Multiplexer::open_stream(AbstractSocket::DeathHandler death_handler) {
+    auto stream = add_stream(m_next_stream_id++, death_handler);
+    send_frame(MUX_OPEN, stream->id());
+    return stream;
+}
+
+shared_ptr<StreamSocket> Multiplexer::accept_stream(u_int32_t id, AbstractSocket::DeathHandler death_handler) {
+    return add_stream(id, death_handler);
+}
+
+shared_ptr<StreamSocket> Multiplexer::add_stream(u_int32_t id, AbstractSocket::DeathHandler death_handler) {
+    auto stream = make_shared<StreamSocket>(*this, id, m_strand, death_handler);
+    m_streams[id] = stream;
+    return stream;
+}
+
+void Multiplexer::start() {
+    m_socket->on_received_data(bind(&Multiplexer::on_receive, this, _1));
+}
+
+void Multiplexer::close_streams(const string& reason) {
+    // Note: closing a stream removes it from m_streams
+    vector<shared_ptr<StreamSocket>> streams;
+    for (auto& entry : m_streams) {
+        streams.push_back(entry.second);
+    }
+    for (auto& stream : streams) {
+        stream->handle_close(reason);
+    }
+    m_streams.clear();
+}
+
+void Multiplexer::remove_stream(u_int32_t stream_id) {
+    m_streams.erase(stream_id);
+}
+
+void Multiplexer::send_frame(mux_frame_type type, u_int32_t stream_id, ChunkBuffer& payload) {
+    mux_frame frame;
+    memset(&frame, 0, sizeof(mux_frame));
+    frame.stream_id = stream_id;
+    frame.length = payload.size();
+    frame.type = type;
+
+    ChunkBuffer buffer;
+    buffer.append(reinterpret_cast<const char*>(&frame), sizeof(mux_frame));
+    buffer.append(payload);
+    m_socket->send(buffer);
+}
+
+void Multiplexer::send_frame(mux_frame_type type, u_int32_t stream_id) {
+    ChunkBuffer payload;
+    send_frame(type, stream_id, payload);
+}
+
+void Multiplexer::on_receive(ChunkBuffer& buffer) {
+    while (buffer.size() >= sizeof(mux_frame)) {
+        mux_frame frame;
+        buffer.copy(reinterpret_cast<char*>(&frame), sizeof(mux_frame));
+        if (frame.length > StreamSocket::window_size) {
+            // no stream may send more than its window, don't buffer such a frame
+            stringstream reason;
+            reason << "Invalid mux frame of " << frame.length << " bytes";
+            m_socket->kill(reason.str());
+            return;
+        }
+        if (buffer.size() < sizeof(mux_frame) + frame.length) {
+            break;
+        }
+
+        buffer.consume(sizeof(mux_frame));
+        ChunkBuffer payload;
+        payload.append(buffer, frame.length);
+        handle_frame(frame, payload);
+        if (m_socket->disposed()) return;  // killed for violating the protocol
+    }
+}
+
+void Multiplexer::handle_frame(const mux_frame& frame, ChunkBuffer& payload) {
+    if (frame.type == MUX_OPEN) {
+        if (m_open_handler && m_streams.find(frame.stream_id) == m_streams.end()) {
+            m_open_handler(frame.stream_id);
+        }
+        else {
+            BOOST_LOG_TRIVIAL(warning) << "Warning: ignoring request to open stream " << frame.stream_id << endl;
+            send_frame(MUX_CLOSE, frame.stream_id);
+        }
+        return;
+    }
+
+    auto it = m_streams.find(frame.stream_id);
+    if (it == m_streams.end()) {
+        return;  // stream already closed on our side
+    }
+    auto stream = it->second;  // Note: keeps stream alive when it's closed while handling the frame
+
+    switch (frame.type) {
+        case MUX_DATA:
+            if (!stream->handle_data(payload)) {
+                stringstream reason;
+                reason << "Stream " << frame.stream_id << " exceeded its window";
+                m_socket->kill(reason.str());
+            }
+            break;
+
+        case MUX_WINDOW:
+            if (payload.size() == sizeof(u_int32_t)) {
+                u_int32_t increment;
+                payload.copy(reinterpret_cast<char*>(&increment), sizeof(u_int32_t));
+                stream->handle_window(increment);
+            }
+            break;
+
+        case MUX_CLOSE:
+            stream->handle_close("closed by peer");
+            break;
+
+        default:
+            BOOST_LOG_TRIVIAL(warning) << "Warning: ignoring mux frame of unknown type " << static_cast<int>(frame.type) << endl;
+    }
+}
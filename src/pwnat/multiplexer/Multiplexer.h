@@ -0,0 +1,93 @@
+/*
+ * Copyright (C) 2013 by Tim Diels
+ *
+ * This file is part of pwnat.
+ *
+ * pwnat is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * pwnat is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with pwnat.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <map>
+#include <memory>
+#include <boost/asio.hpp>
+#include <pwnat/packet.h>
+#include "StreamSocket.h"
+
+/**
+ * Carries multiple streams over one socket, see mux_frame
+ *
+ * Must be used in the strand of the socket, its streams share that strand.
+ */
+class Multiplexer {
+public:
+    /**
+     * Called when the other side opened a stream, should accept_stream it
+     */
+    typedef std::function<void(u_int32_t stream_id)> OpenHandler;
+
+public:
+    /**
+     * open_handler: if not set, streams opened by the other side are refused
+     */
+    Multiplexer(std::shared_ptr<AbstractSocket> socket, boost::asio::io_service::strand, OpenHandler open_handler = OpenHandler());
+
+    /**
+     * Closes all streams
+     */
+    ~Multiplexer();
+
+    /**
+     * Take over handling the received data of the socket
+     */
+    void start();
+
+    /**
+     * Open a new stream
+     */
+    std::shared_ptr<StreamSocket> open_stream(AbstractSocket::DeathHandler);
+
+    /**
+     * Accept stream opened by the other side
+     */
+    std::shared_ptr<StreamSocket> accept_stream(u_int32_t id, AbstractSocket::DeathHandler);
+
+    /**
+     * Close all streams
+     */
+    void close_streams(const std::string& reason);
+
+    /**
+     * Send frame with payload, consumes payload
+     */
+    void send_frame(mux_frame_type, u_int32_t stream_id, ChunkBuffer& payload);
+    void send_frame(mux_frame_type, u_int32_t stream_id);
+
+    /**
+     * Forget stream, called by stream when it's disposed
+     */
+    void remove_stream(u_int32_t stream_id);
+
+private:
+    void on_receive(ChunkBuffer& buffer);
+    void handle_frame(const mux_frame&, ChunkBuffer& payload);
+    std::shared_ptr<StreamSocket> add_stream(u_int32_t id, AbstractSocket::DeathHandler);
+
+private:
+    std::shared_ptr<AbstractSocket> m_socket;
+    boost::asio::io_service::strand m_strand;
+    OpenHandler m_open_handler;
+    std::map<u_int32_t, std::shared_ptr<StreamSocket>> m_streams;
+    u_int32_t m_next_stream_id;
+};
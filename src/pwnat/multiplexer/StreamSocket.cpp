@@ -0,0 +1,135 @@
+/*
+ * Copyright (C) 2013 by Tim Diels
+ *
+ * This file is part of pwnat.
+ *
+ * pwnat is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * pwnat is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with pwnat.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "StreamSocket.h"
+#include <cassert>
+#include <sstream>
+#include <pwnat/packet.h>
+#include "Multiplexer.h"
+#include <boost/log/trivial.hpp>
+
+#include <pwnat/namespaces.h>
+
+const u_int32_t StreamSocket::window_size;
+
+static string get_name(u_int32_t id) {
+    stringstream str;
+    str << "Stream " << id;
+    return str.str();
+}
+
+StreamSocket::StreamSocket(Multiplexer& multiplexer, u_int32_t id, asio::io_service::strand strand, DeathHandler death_handler) :
+    AbstractSocket(true, strand, death_handler, get_name(id)),
+    m_multiplexer(multiplexer),
+    m_id(id),
+    m_closed_by_peer(false),
+    m_send_window(window_size),
+    m_receive_window(window_size),
+    m_consumed(0)
+{
+}
+
+StreamSocket::~StreamSocket() {
+    dispose();
+}
+
+void StreamSocket::connect(u_int16_t source_port, asio::ip::address destination, u_int16_t destination_port) {
+    assert(false);
+}
+
+void StreamSocket::receive_data_from(AbstractSocket& socket) {
+    socket.on_received_data(bind(&StreamSocket::send, shared_from_this(), _1));
+    set_data_source(socket);
+}
+
+bool StreamSocket::dispose() {
+    if (AbstractSocket::dispose()) {
+        if (!m_closed_by_peer) {
+            m_multiplexer.send_frame(MUX_CLOSE, m_id);
+        }
+        m_multiplexer.remove_stream(m_id);
+        return true;
+    }
+    else {
+        return false;
+    }
+}
+
+u_int32_t StreamSocket::id() {
+    return m_id;
+}
+
+bool StreamSocket::handle_data(ChunkBuffer& data) {
+    if (disposed()) return true;
+    if (data.size() > m_receive_window) {
+        return false;  // don't buffer what a peer ignoring our window sends, even while paused
+    }
+
+    BOOST_LOG_TRIVIAL(trace) << m_name << " received " << data.size() << endl;
+    m_receive_window -= data.size();
+    m_receive_buffer.append(data);
+    start_receiving();
+    return true;
+}
+
+void StreamSocket::handle_window(u_int32_t increment) {
+    if (disposed()) return;
+    m_send_window += increment;
+    start_sending();
+}
+
+void StreamSocket::handle_close(const string& reason) {
+    m_closed_by_peer = true;
+    close(reason);
+}
+
+void StreamSocket::start_receiving() {
+    if (disposed() || receiving_paused() || m_receive_buffer.size() == 0) return;
+    notify_received_data();
+}
+
+void StreamSocket::notify_received_data() {
+    size_t size = m_receive_buffer.size();
+    AbstractSocket::notify_received_data();
+    if (disposed()) return;
+    m_consumed += size - m_receive_buffer.size();
+
+    // announce consumed data in batches
+    if (m_consumed >= window_size / 4) {
+        ChunkBuffer payload;
+        payload.append(reinterpret_cast<const char*>(&m_consumed), sizeof(u_int32_t));
+        m_multiplexer.send_frame(MUX_WINDOW, m_id, payload);
+        m_receive_window += m_consumed;
+        m_consumed = 0;
+    }
+}
+
+void StreamSocket::start_sending() {
+    if (disposed()) return;
+
+    const size_t max_frame_size = ChunkBuffer::chunk_size;
+    while (m_send_window > 0 && m_send_buffer.size() > 0) {
+        size_t size = min(min(static_cast<size_t>(m_send_window), m_send_buffer.size()), max_frame_size);
+        ChunkBuffer payload;
+        payload.append(m_send_buffer, size);
+        m_multiplexer.send_frame(MUX_DATA, m_id, payload);
+        m_send_window -= size;
+    }
+    update_flow_control();
+}
@@ -0,0 +1,83 @@
+/*
+ * Copyright (C) 2013 by Tim Diels
+ *
+ * This file is part of pwnat.
+ *
+ * pwnat is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * pwnat is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with pwnat.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <memory>
+#include <pwnat/AbstractSocket.h>
+
+class Multiplexer;
+
+/**
+ * Stream of a multiplexed UDT connection
+ *
+ * Created by Multiplexer. Is connected from the start.
+ *
+ * Flow control: each side may send up to window_size bytes more than the other
+ * side has consumed. Receivers announce consumed data with MUX_WINDOW frames.
+ * Data that can't be sent yet stays in the send buffer, so the watermarks of
+ * AbstractSocket push back on the socket we receive data from.
+ */
+class StreamSocket : public AbstractSocket, public std::enable_shared_from_this<StreamSocket> {
+public:
+    static const u_int32_t window_size = 256 * 1024;
+
+public:
+    StreamSocket(Multiplexer&, u_int32_t id, boost::asio::io_service::strand, DeathHandler);
+    ~StreamSocket();
+
+    /**
+     * Not supported, streams are opened through their Multiplexer
+     */
+    void connect(u_int16_t source_port, boost::asio::ip::address destination, u_int16_t destination_port);
+    void receive_data_from(AbstractSocket& socket);
+    bool dispose() override;
+
+    u_int32_t id();
+
+    /**
+     * Handle data received from the other side of the stream
+     *
+     * Returns false if the other side sent more than the window we granted it.
+     */
+    bool handle_data(ChunkBuffer& data);
+
+    /**
+     * Handle window increase received from the other side of the stream
+     */
+    void handle_window(u_int32_t increment);
+
+    /**
+     * Handle the other side closing the stream, or the multiplexed connection closing
+     */
+    void handle_close(const std::string& reason);
+
+protected:
+    void start_receiving();
+    void start_sending();
+    void notify_received_data() override;
+
+private:
+    Multiplexer& m_multiplexer;
+    const u_int32_t m_id;
+    bool m_closed_by_peer;
+    u_int32_t m_send_window; // bytes we may still send
+    u_int32_t m_receive_window; // bytes the other side may still send
+    u_int32_t m_consumed; // bytes consumed since we last announced a window increase
+};
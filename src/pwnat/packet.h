@@ -43,9 +43,61 @@ struct icmp_ttl_exceeded {
 
 /**
  * ProxyClient sends this to ProxyServer to initialize a newly connected UDT flow
+ *
+ * A flow init with remote_port == udt_flow_multiplexed and no remote_host
+ * initializes a multiplexed UDT flow: the rest of the flow consists of
+ * mux_frames. The first data of each stream is a regular flow init.
  */
 struct udt_flow_init {
     u_int16_t size; // size of flow_init, including remote_host chars
     u_int16_t remote_port;
     // char* remote_host, not zero terminated
 };
+
+const u_int16_t udt_flow_multiplexed = 0;
+
+/**
+ * Seconds a connected UDT flow may go without sending its flow init
+ *
+ * Pooled connections are connected well before they're used, so the pool idle
+ * timeout of the client must stay below this.
+ */
+const long udt_flow_init_timeout = 600;
+
+enum mux_frame_type : u_int8_t {
+    MUX_OPEN,  // open stream, no payload
+    MUX_DATA,  // stream data
+    MUX_WINDOW,  // payload: u_int32_t, number of bytes the sender of the frame may send in addition
+    MUX_CLOSE  // close stream, no payload
+};
+
+/**
+ * Frame of a multiplexed UDT flow, followed by length bytes of payload
+ */
+struct mux_frame {
+    u_int32_t stream_id;
+    u_int32_t length;
+    mux_frame_type type;
+};
+
+/**
+ * Sent instead of udt_flow_init on each UDT connection of a striped flow
+ *
+ * The UDT connections of a striped flow share the flow id of their ICMP
+ * messages. Once all stripe_count of them are connected, they carry
+ * stripe_segments, the first of which starts with a regular flow init.
+ */
+struct udt_stripe_init {
+    u_int16_t zero; // 0, where udt_flow_init has its size
+    u_int16_t stripe_count;
+};
+
+/**
+ * Segment of a striped flow, followed by length bytes of payload
+ *
+ * Segments are sent over any stripe, the receiver reorders them by sequence.
+ */
+struct stripe_segment {
+    u_int32_t sequence;
+    u_int32_t length;
+};
@@ -0,0 +1,204 @@
+/*
+ * Copyright (C) 2013 by Tim Diels
+ *
+ * This file is part of pwnat.
+ *
+ * pwnat is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * pwnat is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with pwnat.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <cstring>
+#include <vector>
+#include <boost/asio.hpp>
+
+/**
+ * Packed fixed-size key of a ProxyClient: address, flow id and client port
+ *
+ * IPv4 addresses are stored as IPv4-mapped IPv6 addresses.
+ */
+struct ClientKey {
+    ClientKey(const boost::asio::ip::address& address, u_int16_t flow_id, u_int16_t client_port) :
+        flow_id(flow_id),
+        client_port(client_port)
+    {
+        using boost::asio::ip::address_v6;
+        auto bytes = address.is_v6() ? address.to_v6().to_bytes() : address_v6::v4_mapped(address.to_v4()).to_bytes();
+        memcpy(this->address, bytes.data(), sizeof(this->address));
+    }
+
+    bool operator== (const ClientKey& b) const {
+        return memcmp(this, &b, sizeof(ClientKey)) == 0;
+    }
+
+    size_t hash() const {
+        u_int64_t words[3] = {0, 0, 0};
+        memcpy(words, this, sizeof(ClientKey));
+
+        // mix each word into the hash (multiply-xorshift, see splitmix64)
+        u_int64_t hash = 0;
+        for (auto word : words) {
+            hash = (hash ^ word) * 0xbf58476d1ce4e5b9ULL;
+            hash ^= hash >> 31;
+        }
+        return hash;
+    }
+
+    u_int8_t address[16];
+    u_int16_t flow_id;
+    u_int16_t client_port;
+};
+
+/**
+ * Hash table of ClientKey to Value
+ *
+ * Open addressing with linear probing, deletion shifts back the following
+ * entries so there are no tombstones. Stays at most half full, so lookups
+ * take a couple of probes regardless of size.
+ *
+ * Not thread safe. Values are moved around when the table grows, store
+ * pointers to keep handles stable.
+ */
+template <typename Value>
+class ClientIndex {
+public:
+    ClientIndex() :
+        m_slots(16),
+        m_size(0)
+    {
+    }
+
+    /**
+     * Get value of key, or nullptr if not present
+     *
+     * Valid until the table is modified.
+     */
+    Value* find(const ClientKey& key) {
+        for (size_t i = index_of(key); m_slots[i].used; i = next(i)) {
+            if (m_slots[i].key == key) {
+                return &m_slots[i].value;
+            }
+        }
+        return nullptr;
+    }
+
+    /**
+     * Insert key with value, unless key is already present
+     *
+     * Returns true if inserted.
+     */
+    bool insert(const ClientKey& key, const Value& value) {
+        if (find(key)) {
+            return false;
+        }
+
+        if (2 * (m_size + 1) > m_slots.size()) {
+            grow();
+        }
+        place(key, value);
+        m_size++;
+        return true;
+    }
+
+    /**
+     * Remove key, returns true if it was present
+     */
+    bool erase(const ClientKey& key) {
+        size_t hole = index_of(key);
+        for (; m_slots[hole].used; hole = next(hole)) {
+            if (m_slots[hole].key == key) {
+                break;
+            }
+        }
+        if (!m_slots[hole].used) {
+            return false;
+        }
+
+        // shift back entries that would no longer be reachable past the hole
+        for (size_t i = next(hole); m_slots[i].used; i = next(i)) {
+            size_t home = index_of(m_slots[i].key);
+            bool reachable = hole <= i ? (home > hole && home <= i) : (home > hole || home <= i);
+            if (!reachable) {
+                m_slots[hole] = m_slots[i];
+                hole = i;
+            }
+        }
+        m_slots[hole] = Slot();
+        m_size--;
+        return true;
+    }
+
+    size_t size() const {
+        return m_size;
+    }
+
+    /**
+     * Call f(const ClientKey&, Value&) for each entry
+     */
+    template <typename F>
+    void for_each(F f) {
+        for (auto& slot : m_slots) {
+            if (slot.used) {
+                f(slot.key, slot.value);
+            }
+        }
+    }
+
+private:
+    struct Slot {
+        Slot() :
+            used(false),
+            key(boost::asio::ip::address_v6(), 0, 0),
+            value()
+        {
+        }
+
+        bool used;
+        ClientKey key;
+        Value value;
+    };
+
+private:
+    size_t index_of(const ClientKey& key) const {
+        return key.hash() & (m_slots.size() - 1);
+    }
+
+    size_t next(size_t i) const {
+        return (i + 1) & (m_slots.size() - 1);
+    }
+
+    void place(const ClientKey& key, const Value& value) {
+        size_t i = index_of(key);
+        while (m_slots[i].used) {
+            i = next(i);
+        }
+        m_slots[i].used = true;
+        m_slots[i].key = key;
+        m_slots[i].value = value;
+    }
+
+    void grow() {
+        std::vector<Slot> slots(2 * m_slots.size());
+        slots.swap(m_slots);
+        for (auto& slot : slots) {
+            if (slot.used) {
+                place(slot.key, slot.value);
+            }
+        }
+    }
+
+private:
+    std::vector<Slot> m_slots; // size is a power of 2
+    size_t m_size;
+};
@@ -18,34 +18,91 @@
  */
 
 #include "ProxyClient.h"
-#include <pwnat/udtservice/UDTService.h>
+#include <pwnat/udtservice/UDTServicePool.h>
 #include <pwnat/packet.h>
 #include "ProxyServer.h"
+#include <pwnat/StripedSocket.h>
+#include <pwnat/metrics/Counter.h>
+#include <pwnat/metrics/Histogram.h>
+#include <pwnat/Watchdog.h>
 #include <boost/log/trivial.hpp>
 
 #include <pwnat/namespaces.h>
 
-ProxyClient::ProxyClient(ProxyServer& server, asio::io_service& io_service, UDTService& udt_service, ProxyClient::Id id) : 
+static Histogram udt_connect_time("pwnat_setup_seconds", "side=\"server\",stage=\"udt_connect\"", "Time taken by each stage of setting up a tunnel");
+static Histogram flow_init_time("pwnat_setup_seconds", "side=\"server\",stage=\"flow_init\"", "Time taken by each stage of setting up a tunnel");
+static Histogram resolve_time("pwnat_setup_seconds", "side=\"server\",stage=\"resolve\"", "Time taken by each stage of setting up a tunnel");
+static Histogram connect_time("pwnat_setup_seconds", "side=\"server\",stage=\"connect\"", "Time taken by each stage of setting up a tunnel");
+static Counter proxy_clients("pwnat_proxy_clients", "Proxy clients alive on the server", Counter::GAUGE);
+
+const long ProxyClient::flow_init_timeout_seconds;
+
+ProxyClient::ProxyClient(ProxyServer& server, asio::io_service& io_service, asio::io_service::strand strand, UDTServicePool& udt_services, ProxyClient::Id id) : 
+    m_id(id),
+    m_io_service(io_service),
+    m_server(server),
+    m_strand(strand),
+    m_tcp_socket(make_shared<TCPSocket>(io_service, m_strand, bind(&ProxyClient::die, this))),
+    m_udt_socket(make_shared<UDTSocket>(udt_services, m_strand, bind(&ProxyClient::die, this))),
+    m_client_socket(m_udt_socket),
+    m_lifetime(make_shared<int>(0)),
+    m_remote_port(0),
+    m_flow_init_timer(m_io_service),
+    m_is_stream(false)
+{
+    proxy_clients.add();
+    // start in our strand, so that no handler of ours can run before we've started
+    m_strand.post(Watchdog::watch(bind(&ProxyClient::start, this)));
+}
+
+ProxyClient::ProxyClient(ProxyServer& server, asio::io_service& io_service, asio::io_service::strand strand, Multiplexer& multiplexer, ProxyClient::Id id, u_int32_t stream_id) :
     m_id(id),
     m_io_service(io_service),
     m_server(server),
-    m_tcp_socket(make_shared<TCPSocket>(io_service, bind(&ProxyClient::die, this))),
-    m_udt_socket(make_shared<UDTSocket>(udt_service, bind(&ProxyClient::die, this))),
-    m_resolver(m_io_service)
+    m_strand(strand),
+    m_tcp_socket(make_shared<TCPSocket>(io_service, m_strand, bind(&ProxyClient::die, this))),
+    m_client_socket(multiplexer.accept_stream(stream_id, bind(&ProxyClient::die, this))),
+    m_lifetime(make_shared<int>(0)),
+    m_remote_port(0),
+    m_flow_init_timer(m_io_service),
+    m_is_stream(true)
 {
+    proxy_clients.add();
+}
+
+void ProxyClient::start() {
     auto& args = Application::instance().args();
 
-    m_udt_socket->init();
-    m_udt_socket->on_received_data(bind(&ProxyClient::on_receive_udt, this, _1));
-    m_udt_socket->connect(args.proxy_port(), id.address, id.client_port);
+    try {
+        m_client_socket->init();
+        m_client_socket->on_received_data(bind(&ProxyClient::on_receive_flow_init, this, _1));
+        m_stage_start = chrono::steady_clock::now();
+        if (m_udt_socket) {
+            m_udt_socket->on_connected(bind(&ProxyClient::on_udt_connected, this));
+            m_udt_socket->connect(args.proxy_port(), m_id.address, m_id.client_port);
+
+            start_flow_init_timer(flow_init_timeout_seconds);
+        }
 
-    m_tcp_socket->init();
+        m_tcp_socket->init();
 
-    m_udt_socket->receive_data_from(*m_tcp_socket);
+        m_client_socket->receive_data_from(*m_tcp_socket);
+    }
+    catch (const exception& e) {
+        BOOST_LOG_TRIVIAL(error) << "Failed to start client: " << e.what() << endl;
+        die();
+    }
 }
 
 ProxyClient::~ProxyClient() {
-    m_udt_socket->dispose();
+    proxy_clients.add(-1);
+    m_multiplexer.reset();  // Note: this kills the ProxyClients of the streams
+    if (m_connector) {
+        m_connector->cancel();
+    }
+    if (m_client_socket) {
+        m_client_socket->dispose();
+    }
     m_tcp_socket->dispose();
     BOOST_LOG_TRIVIAL(debug) << "ProxyClient: Deallocated" << endl;
 }
@@ -54,39 +111,182 @@ const ProxyClient::Id& ProxyClient::id() {
     return m_id;
 }
 
+asio::io_service::strand& ProxyClient::strand() {
+    return m_strand;
+}
+
 void ProxyClient::die() {
-    m_server.kill_client(*this);
+    if (m_is_stream) {
+        delete this;
+    }
+    else {
+        m_server.kill_client(*this);
+    }
 }
 
 // TODO check what happens when: TCP client dies/eofs, pwnat client closes cleanly, pwnat server closes cleanly, TCP server pwnat connects to dies
 // used only initially to receive the udt_flow_init
-void ProxyClient::on_receive_udt(asio::streambuf& receive_buffer) {
-    auto& args = Application::instance().args();
-    if (receive_buffer.size() > sizeof(udt_flow_init)) {
-        auto* buffer = asio::buffer_cast<const char*>(receive_buffer.data());
-        auto* flow_init = reinterpret_cast<const udt_flow_init*>(buffer);
-        if (flow_init->size <= receive_buffer.size()) {
-            string remote_host(buffer + sizeof(udt_flow_init), flow_init->size - sizeof(udt_flow_init));
-            receive_buffer.consume(flow_init->size);
-            m_tcp_socket->receive_data_from(*m_udt_socket);  // this also unsets our on_receive handler
-
-            BOOST_LOG_TRIVIAL(debug) << "Resolving " << remote_host << ":" << flow_init->remote_port << endl;
-            stringstream str;
-            str << flow_init->remote_port;
-            asio::ip::tcp::resolver::query query(args.tcp_version(), remote_host, str.str());
-            m_resolver.async_resolve(query, bind(&ProxyClient::on_resolved_remote_host, this, asio::placeholders::error, asio::placeholders::iterator));
+void ProxyClient::on_receive_flow_init(ChunkBuffer& receive_buffer) {
+    if (receive_buffer.size() >= sizeof(udt_flow_init)) {
+        udt_flow_init flow_init;
+        receive_buffer.copy(reinterpret_cast<char*>(&flow_init), sizeof(udt_flow_init));
+        bool is_udt_flow = m_client_socket == m_udt_socket;  // rather than a stream or striped flow
+        if (flow_init.size == 0 && is_udt_flow) {
+            udt_stripe_init stripe_init;
+            receive_buffer.copy(reinterpret_cast<char*>(&stripe_init), sizeof(udt_stripe_init));
+            receive_buffer.consume(sizeof(udt_stripe_init));
+            join_stripe(stripe_init.stripe_count);
+        }
+        else if (flow_init.size < sizeof(udt_flow_init)) {
+            BOOST_LOG_TRIVIAL(error) << "Invalid flow init" << endl;
+            die();
+        }
+        else if (flow_init.size <= receive_buffer.size()) {
+            vector<char> buffer(flow_init.size);
+            receive_buffer.copy(buffer.data(), buffer.size());
+            string remote_host(buffer.data() + sizeof(udt_flow_init), flow_init.size - sizeof(udt_flow_init));
+            receive_buffer.consume(flow_init.size);
+            m_flow_init_timer.expires_at(boost::posix_time::pos_infin);  // cancels, also an expiry that was already queued
+            if (m_is_stream) {
+                m_stage_start = chrono::steady_clock::now();  // stream data follows its open right away, not worth recording
+            }
+            else {
+                record_stage(flow_init_time);
+            }
+
+            if (flow_init.remote_port == udt_flow_multiplexed && is_udt_flow) {
+                BOOST_LOG_TRIVIAL(debug) << "Multiplexing UDT connection" << endl;
+                m_tcp_socket->dispose();  // unused, each stream has its own
+                auto open_handler = bind(&ProxyClient::on_stream_opened, this, _1);
+                m_multiplexer.reset(new Multiplexer(m_udt_socket, m_strand, open_handler));
+                m_multiplexer->start();  // this also unsets our on_receive handler
+                return;
+            }
+
+            m_tcp_socket->receive_data_from(*m_client_socket);  // this also unsets our on_receive handler
+
+            BOOST_LOG_TRIVIAL(debug) << "Resolving " << remote_host << ":" << flow_init.remote_port << endl;
+            m_remote_host = remote_host;
+            m_remote_port = flow_init.remote_port;
+            weak_ptr<int> lifetime = m_lifetime;
+            auto callback = [this, lifetime](boost::system::error_code error, const CachingResolver::Addresses& addresses) {
+                if (!lifetime.expired()) {
+                    on_resolved_remote_host(error, addresses);
+                }
+            };
+            Application::instance().resolver().async_resolve(remote_host, m_strand.wrap(Watchdog::watch(callback)));  // Note: any address family, see HappyEyeballs
         }
     }
 }
 
-void ProxyClient::on_resolved_remote_host(const boost::system::error_code& error, asio::ip::tcp::resolver::iterator result) {
+void ProxyClient::on_udt_connected() {
+    record_stage(udt_connect_time);
+
+    // the client may be a pooled connection, which sends its flow init once it's used
+    start_flow_init_timer(udt_flow_init_timeout);
+}
+
+void ProxyClient::start_flow_init_timer(long seconds) {
+    m_flow_init_timer.expires_from_now(boost::posix_time::seconds(seconds));
+
+    // Note: the expiry may already be queued when we're killed, it must not touch us then
+    weak_ptr<int> lifetime = m_lifetime;
+    auto callback = [this, lifetime](const boost::system::error_code& error) {
+        if (!lifetime.expired()) {
+            on_flow_init_timeout(error);
+        }
+    };
+    m_flow_init_timer.async_wait(m_strand.wrap(Watchdog::watch(callback)));
+}
+
+void ProxyClient::record_stage(Histogram& histogram) {
+    auto now = chrono::steady_clock::now();
+    histogram.record(now - m_stage_start);
+    m_stage_start = now;
+}
+
+void ProxyClient::on_flow_init_timeout(const boost::system::error_code& error) {
+    if (error || m_flow_init_timer.expires_at() > asio::deadline_timer::traits_type::now()) {
+        return;  // cancelled, or extended after this expiry was queued
+    }
+
+    BOOST_LOG_TRIVIAL(info) << "Expiring proxy client that sent no flow init: ip=" << m_id.address << " flow=" << m_id.flow_id << " port=" << m_id.client_port << endl;
+    die();
+}
+
+void ProxyClient::on_stream_opened(u_int32_t stream_id) {
+    BOOST_LOG_TRIVIAL(debug) << "Accepting stream " << stream_id << endl;
+    auto client = new ProxyClient(m_server, m_io_service, m_strand, *m_multiplexer, m_id, stream_id);  // Note: deletes itself
+    client->start();  // Note: we're already in its strand
+}
+
+void ProxyClient::join_stripe(u_int16_t stripe_count) {
+    m_udt_socket->on_received_data([](ChunkBuffer&){});  // leave the segments to the striped socket
+    m_udt_socket->clear_data_source();  // flow control goes through the striped socket
+
+    vector<ProxyClient*> others;
+    if (!m_server.join_stripe(*this, stripe_count, others)) {
+        return;  // the last one to join takes over
+    }
+
+    BOOST_LOG_TRIVIAL(debug) << "Striping flow over " << stripe_count << " UDT connections" << endl;
+    vector<shared_ptr<AbstractSocket>> stripes;
+    stripes.push_back(m_udt_socket);
+    for (auto client : others) {
+        auto udt_socket = client->release_udt_socket();
+        udt_socket->on_death(bind(&ProxyClient::die, this));
+        stripes.push_back(udt_socket);
+        m_server.kill_client(*client);
+    }
+
+    auto striped_socket = make_shared<StripedSocket>(stripes, m_strand, bind(&ProxyClient::die, this));
+    m_client_socket = striped_socket;
+    m_client_socket->receive_data_from(*m_tcp_socket);
+    m_client_socket->on_received_data(bind(&ProxyClient::on_receive_flow_init, this, _1));
+    striped_socket->start();
+    striped_socket->init();
+}
+
+shared_ptr<UDTSocket> ProxyClient::release_udt_socket() {
+    auto udt_socket = m_udt_socket;
+    udt_socket->clear_data_source();  // our tcp socket dies with us
+    m_udt_socket.reset();
+    m_client_socket.reset();
+    return udt_socket;
+}
+
+void ProxyClient::on_resolved_remote_host(const boost::system::error_code& error, const CachingResolver::Addresses& addresses) {
+    record_stage(resolve_time);
     if (error) {
         BOOST_LOG_TRIVIAL(error) << "Could not resolve: " << error.message() << endl;
         die();
     }
     else {
-        const auto& endpoint = result->endpoint();
-        BOOST_LOG_TRIVIAL(debug) << "Connecting to " << result->host_name() << ":" << endpoint.port() << endl;
-        m_tcp_socket->connect(0, endpoint.address(), endpoint.port());
+        vector<asio::ip::tcp::endpoint> endpoints;
+        for (auto& address : addresses) {
+            endpoints.push_back(asio::ip::tcp::endpoint(address, m_remote_port));
+        }
+        BOOST_LOG_TRIVIAL(debug) << "Connecting to " << m_remote_host << " (" << endpoints.size() << " addresses)" << endl;
+        auto preferred = m_server.remote_endpoints().get(m_remote_host);
+        HappyEyeballs::ConnectHandler callback = bind(&ProxyClient::on_connected_remote_host, this, _1, _2);
+        m_connector = make_shared<HappyEyeballs>(m_io_service, m_strand, endpoints, preferred, callback);
+        m_connector->start();
+    }
+}
+
+void ProxyClient::on_connected_remote_host(boost::system::error_code error, shared_ptr<asio::ip::tcp::socket> socket) {
+    m_connector.reset();
+    if (error) {
+        BOOST_LOG_TRIVIAL(error) << "Could not connect to " << m_remote_host << ": " << error.message() << endl;
+        die();
+    }
+    else {
+        record_stage(connect_time);
+        auto endpoint = socket->remote_endpoint(error);
+        BOOST_LOG_TRIVIAL(debug) << "Connected to " << m_remote_host << " at " << endpoint << endl;
+        if (!error) {
+            m_server.remote_endpoints().set(m_remote_host, endpoint);
+        }
+        m_tcp_socket->take_connected(socket);
     }
 }
@@ -20,39 +20,58 @@
 #pragma once
 
 #include "ProxyClient.h"
+#include <chrono>
+#include <memory>
+#include <tuple>
 #include <boost/asio.hpp>
 #include <pwnat/UDTSocket.h>
 #include <pwnat/Socket.h>
+#include <pwnat/multiplexer/Multiplexer.h>
+#include <pwnat/HappyEyeballs.h>
+#include <pwnat/CachingResolver.h>
 
-class UDTService;
+class UDTServicePool;
+class Histogram;
 class ProxyServer;
 
+/**
+ * A tunnel from a pwnat client to a remote host
+ *
+ * Either has a UDT connection of its own, or is a stream of a multiplexed UDT
+ * connection. The ProxyClient of a multiplexed connection creates a
+ * ProxyClient per stream, which share its strand.
+ *
+ * The UDT connections of a striped flow each start out with a ProxyClient.
+ * The one that completes the stripe group takes over the UDT sockets of the
+ * others, which are then killed.
+ *
+ * All its handlers run in its own strand.
+ */
 class ProxyClient {
 public:
-    // uniquely identifies a proxy client
+    /**
+     * Uniquely identifies a proxy client
+     *
+     * flow_id and client_port are the id and sequence of the client's ICMP
+     * echo, a 32 bit identifier per client address. Only the first 8 bytes of
+     * the echo are quoted in a ttl exceeded message, so there's no room for more.
+     */
     class Id {
     public:
         bool operator== (const Id& b) const {
             return flow_id == b.flow_id && address == b.address && client_port == b.client_port;
         }
 
-        bool operator> (const Id& b) const {
-            if (flow_id > b.flow_id)
-                return true;
-            else if (address > b.address)
-                return true;
-            else if (client_port > b.client_port)
-                return true;
-            else
-                return false;
+        bool operator< (const Id& b) const {
+            return std::tie(flow_id, address, client_port) < std::tie(b.flow_id, b.address, b.client_port);
         }
 
-        bool operator<= (const Id& b) const {
-            return *this == b || *this < b;
+        bool operator> (const Id& b) const {
+            return b < *this;
         }
 
-        bool operator< (const Id& b) const {
-            return !(*this >= b);
+        bool operator<= (const Id& b) const {
+            return !(b < *this);
         }
 
         bool operator>= (const Id& b) const {
@@ -66,22 +85,59 @@ public:
     };
 
 public:
-    ProxyClient(ProxyServer&, boost::asio::io_service& io_service, UDTService& udt_service, ProxyClient::Id client_id);
+    /**
+     * Time in which a client must connect, after which it's considered stale
+     * and killed so its Id can be reused. Once connected, it must send its
+     * flow init within udt_flow_init_timeout
+     */
+    static const long flow_init_timeout_seconds = 30;
+
+public:
+    /**
+     * strand: strand of the client, ProxyClients with the same address and flow_id must share it
+     */
+    ProxyClient(ProxyServer&, boost::asio::io_service& io_service, boost::asio::io_service::strand strand, UDTServicePool& udt_services, ProxyClient::Id client_id);
+
+    /**
+     * Accept stream of multiplexed connection, deletes itself when it dies
+     *
+     * Must be called in strand, caller must start() it afterwards.
+     */
+    ProxyClient(ProxyServer&, boost::asio::io_service& io_service, boost::asio::io_service::strand strand, Multiplexer&, ProxyClient::Id client_id, u_int32_t stream_id);
     virtual ~ProxyClient();
 
     const Id& id();
+    boost::asio::io_service::strand& strand();
 
 private:
+    void start();
     void die();
-    void on_receive_udt(boost::asio::streambuf& receive_buffer);
-    void on_resolved_remote_host(const boost::system::error_code& error, boost::asio::ip::tcp::resolver::iterator result);
+    void on_receive_flow_init(ChunkBuffer& receive_buffer);
+    void start_flow_init_timer(long seconds);
+    void on_flow_init_timeout(const boost::system::error_code& error);
+    void on_udt_connected();
+    void record_stage(Histogram&); // record time since the previous stage
+    void on_stream_opened(u_int32_t stream_id);
+    void join_stripe(u_int16_t stripe_count);
+    std::shared_ptr<UDTSocket> release_udt_socket();
+    void on_resolved_remote_host(const boost::system::error_code& error, const CachingResolver::Addresses& addresses);
+    void on_connected_remote_host(boost::system::error_code error, std::shared_ptr<boost::asio::ip::tcp::socket> socket);
 
 private:
     Id m_id;
     boost::asio::io_service& m_io_service;
     ProxyServer& m_server;
+    boost::asio::io_service::strand m_strand;
     std::shared_ptr<TCPSocket> m_tcp_socket;
-    std::shared_ptr<UDTSocket> m_udt_socket;
-    boost::asio::ip::tcp::resolver m_resolver;
+    std::shared_ptr<UDTSocket> m_udt_socket; // only if we have a UDT connection of our own
+    std::shared_ptr<AbstractSocket> m_client_socket; // socket to the pwnat client: m_udt_socket or a stream
+    std::unique_ptr<Multiplexer> m_multiplexer; // only if our UDT connection is multiplexed
+    std::shared_ptr<int> m_lifetime; // handlers that may outlive us hold a weak_ptr to it
+    std::string m_remote_host;
+    u_int16_t m_remote_port;
+    std::shared_ptr<HappyEyeballs> m_connector; // while connecting to the remote host
+    boost::asio::deadline_timer m_flow_init_timer;
+    std::chrono::steady_clock::time_point m_stage_start; // when the current stage of setting up started
+    const bool m_is_stream;
 };
 
@@ -20,28 +20,47 @@
 #include "ProxyServer.h"
 #include <boost/bind.hpp>
 #include <cassert>
+#include <cerrno>
+#include <cstring>
+#include <algorithm>
+#include <cstddef>
+#include <linux/filter.h>
 #include <pwnat/UDTSocket.h>
 #include <pwnat/packet.h>
 #include <pwnat/util.h>
+#include <pwnat/metrics/Counter.h>
+#include <pwnat/Watchdog.h>
 #include <boost/log/trivial.hpp>
 
 #include <pwnat/namespaces.h>
 
+static Counter icmp_received("pwnat_icmp_received_total", "ICMP packets received by the server");
+static Counter icmp_matched("pwnat_icmp_matched_total", "ICMP ttl exceeded probes of clients received by the server");
+static Counter icmp_echoes_sent("pwnat_icmp_echoes_sent_total", "ICMP echoes sent by the server");
+
+const size_t ProxyServer::receive_batch_size;
+const size_t ProxyServer::receive_slot_size;
+
 ProxyServer::ProxyServer(const ProgramArgs& args) :
     Application(args),
+    m_strand(m_io_service),
     m_socket(m_io_service, asio::ip::icmp::endpoint(args.icmp_version(), 0)),
-    m_icmp_timer(m_io_service)
+    m_icmp_timer(m_io_service),
+    m_icmp_echoes_sent(0),
+    m_receive_batch(receive_batch_size, receive_slot_size)
 {
     args.get_icmp_echo(m_icmp_echo, 0u, 0u);
     m_socket.connect(asio::ip::icmp::endpoint(args.icmp_echo_destination(), 0));
+    m_socket.non_blocking(true);
+    attach_filter();
     send_icmp_echo();
     start_receive();
 }
 
 ProxyServer::~ProxyServer() {
-    for (auto entry : m_clients) {
-        delete entry.second;
-    }
+    m_clients.for_each([](const ClientKey&, ProxyClient* client) {
+        delete client;
+    });
 }
 
 void ProxyServer::send_icmp_echo() {
@@ -49,14 +68,15 @@ void ProxyServer::send_icmp_echo() {
     {
         auto buffer = asio::buffer(m_icmp_echo);
         auto callback = bind(&ProxyServer::handle_send, this, asio::placeholders::error);
-        m_socket.async_send(buffer, callback);
+        m_socket.async_send(buffer, m_strand.wrap(Watchdog::watch(callback)));
+        icmp_echoes_sent.add();
     }
 
     // set timer
     {
-        m_icmp_timer.expires_from_now(boost::posix_time::seconds(5));
+        m_icmp_timer.expires_from_now(boost::posix_time::milliseconds(m_probe_schedule.get_delay(m_icmp_echoes_sent++)));
         auto callback = bind(&ProxyServer::handle_icmp_timer_expired, this, asio::placeholders::error);
-        m_icmp_timer.async_wait(callback);
+        m_icmp_timer.async_wait(m_strand.wrap(Watchdog::watch(callback)));
     }
 }
 
@@ -77,51 +97,88 @@ void ProxyServer::handle_send(const boost::system::error_code& error) {
     }
 }
 
+/*
+ * Let the kernel drop all icmp that isn't a ttl exceeded of our echo, so that
+ * those don't wake us. handle_packet still checks everything itself.
+ */
+void ProxyServer::attach_filter() {
+    auto& args = Application::instance().args();
+    const u_int32_t accept = 0xFFFFFFFF;
+    const u_int32_t reject = 0;
+    vector<sock_filter> filter;
+
+    if (args.is_ipv6()) {
+        // Note: packet starts with ICMPv6 header
+        auto destination = args.icmp_echo_destination().to_v6().to_bytes();
+        const u_int32_t destination_offset = offsetof(icmp6_ttl_exceeded, ip_header.ip6_dst);
+        filter.push_back(BPF_STMT(BPF_LD | BPF_B | BPF_ABS, offsetof(icmp6_ttl_exceeded, icmp.icmp6_type)));
+        filter.push_back(BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, ICMP6_TIME_EXCEEDED, 0, 9));
+        for (u_int8_t i = 0; i < 4; i++) {
+            u_int32_t word = destination[4*i] << 24 | destination[4*i + 1] << 16 | destination[4*i + 2] << 8 | destination[4*i + 3];
+            filter.push_back(BPF_STMT(BPF_LD | BPF_W | BPF_ABS, destination_offset + 4*i));
+            filter.push_back(BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, word, 0, static_cast<u_int8_t>(7 - 2*i)));
+        }
+    }
+    else {
+        // Note: packet starts with IPv4 header, X is set to its length
+        u_int32_t destination = args.icmp_echo_destination().to_v4().to_ulong();
+        filter.push_back(BPF_STMT(BPF_LDX | BPF_B | BPF_MSH, 0));
+        filter.push_back(BPF_STMT(BPF_LD | BPF_B | BPF_IND, offsetof(icmp_ttl_exceeded, icmp.type)));
+        filter.push_back(BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, ICMP_TIME_EXCEEDED, 0, 3));
+        filter.push_back(BPF_STMT(BPF_LD | BPF_W | BPF_IND, offsetof(icmp_ttl_exceeded, ip_header.ip_dst)));
+        filter.push_back(BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, destination, 0, 1));
+    }
+    filter.push_back(BPF_STMT(BPF_RET | BPF_K, accept));
+    filter.push_back(BPF_STMT(BPF_RET | BPF_K, reject));
+
+    sock_fprog program;
+    program.len = filter.size();
+    program.filter = filter.data();
+    if (setsockopt(m_socket.native_handle(), SOL_SOCKET, SO_ATTACH_FILTER, &program, sizeof(program)) < 0) {
+        BOOST_LOG_TRIVIAL(warning) << "Warning: failed to attach icmp filter: " << strerror(errno) << endl;
+    }
+}
+
 void ProxyServer::start_receive() {
-    auto callback = bind(&ProxyServer::handle_receive, this, asio::placeholders::error, asio::placeholders::bytes_transferred);
-    m_socket.async_receive_from(asio::buffer(m_receive_buffer), m_endpoint, callback);
+    auto callback = bind(&ProxyServer::handle_receive, this, asio::placeholders::error);
+    m_socket.async_wait(asio::ip::icmp::socket::wait_read, m_strand.wrap(Watchdog::watch(callback)));
 }
 
-void ProxyServer::handle_receive(boost::system::error_code error, size_t bytes_transferred) {
-    // TODO check received checksum of inner icmp (and ipv4 header; ipv6 has no checksum)
-    using asio::ip::address;
+static asio::ip::address get_address(const sockaddr_storage& address) {
     using asio::ip::address_v4;
     using asio::ip::address_v6;
 
+    if (address.ss_family == AF_INET6) {
+        auto& address6 = reinterpret_cast<const sockaddr_in6&>(address);
+        address_v6::bytes_type bytes;
+        memcpy(bytes.data(), &address6.sin6_addr, bytes.size());
+        return address_v6(bytes, address6.sin6_scope_id);
+    }
+    else {
+        auto& address4 = reinterpret_cast<const sockaddr_in&>(address);
+        return address_v4(ntohl(address4.sin_addr.s_addr));
+    }
+}
+
+void ProxyServer::handle_receive(boost::system::error_code error) {
     if (error) {
         BOOST_LOG_TRIVIAL(warning) << "Warning: icmp receive error: " << error.message() << endl;
     }
     else {
-        auto& args = Application::instance().args();
-
-        if (args.is_ipv6()) {
-            // Note: Buffer starts with ICMPv6 header (there's no such thing as IP_HDRINCL for raw IPv6 sockets)
-            auto header = reinterpret_cast<icmp6_ttl_exceeded*>(m_receive_buffer.data());
-            if (bytes_transferred == sizeof(icmp6_ttl_exceeded) &&
-                address(address_v6(*reinterpret_cast<address_v6::bytes_type*>(&header->ip_header.ip6_dst))) == args.icmp_echo_destination() &&
-                header->icmp.icmp6_type == ICMP6_TIME_EXCEEDED)
-            {
-                ProxyClient::Id client_id;
-                client_id.address = m_endpoint.address();
-                client_id.flow_id = ntohs(header->original_icmp.icmp6_id);
-                client_id.client_port = ntohs(header->original_icmp.icmp6_seq);
-                add_client(client_id);
+        // drain a batch of packets
+        int count = m_receive_batch.receive(m_socket.native_handle());
+        if (count < 0) {
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                BOOST_LOG_TRIVIAL(warning) << "Warning: icmp receive error: " << strerror(errno) << endl;
             }
         }
         else {
-            // Note: Buffer starts with IPv4 header
-            const int ip_header_size = reinterpret_cast<ip*>(m_receive_buffer.data())->ip_hl * 4;
-            auto header = reinterpret_cast<icmp_ttl_exceeded*>(m_receive_buffer.data() + ip_header_size);
-
-            if (bytes_transferred == ip_header_size + sizeof(icmp_ttl_exceeded) &&
-                address(address_v4(*reinterpret_cast<address_v4::bytes_type*>(&header->ip_header.ip_dst))) == args.icmp_echo_destination() &&
-                header->icmp.type == ICMP_TIME_EXCEEDED)
-            {
-                ProxyClient::Id client_id; // TODO ctor
-                client_id.address = m_endpoint.address();
-                client_id.flow_id = ntohs(header->original_icmp.un.echo.id);
-                client_id.client_port = ntohs(header->original_icmp.un.echo.sequence);
-                add_client(client_id);
+            icmp_received.add(count);
+            for (int i = 0; i < count; i++) {
+                if (m_receive_batch.truncated(i)) {
+                    continue;  // larger than a slot, can't be one of ours
+                }
+                handle_packet(m_receive_batch.data(i), m_receive_batch.size(i), get_address(m_receive_batch.sender(i)));
             }
         }
     }
@@ -129,11 +186,70 @@ void ProxyServer::handle_receive(boost::system::error_code error, size_t bytes_t
     start_receive();
 }
 
+void ProxyServer::handle_packet(const char* data, size_t size, const asio::ip::address& sender) {
+    // TODO check received checksum of inner icmp (and ipv4 header; ipv6 has no checksum)
+    using asio::ip::address;
+    using asio::ip::address_v4;
+    using asio::ip::address_v6;
+
+    auto& args = Application::instance().args();
+
+    if (args.is_ipv6()) {
+        // Note: Buffer starts with ICMPv6 header (there's no such thing as IP_HDRINCL for raw IPv6 sockets)
+        auto header = reinterpret_cast<const icmp6_ttl_exceeded*>(data);
+        if (size == sizeof(icmp6_ttl_exceeded) &&
+            address(address_v6(*reinterpret_cast<const address_v6::bytes_type*>(&header->ip_header.ip6_dst))) == args.icmp_echo_destination() &&
+            header->icmp.icmp6_type == ICMP6_TIME_EXCEEDED)
+        {
+            ProxyClient::Id client_id;
+            client_id.address = sender;
+            client_id.flow_id = ntohs(header->original_icmp.icmp6_id);
+            client_id.client_port = ntohs(header->original_icmp.icmp6_seq);
+            icmp_matched.add();
+            add_client(client_id);
+        }
+    }
+    else {
+        // Note: Buffer starts with IPv4 header
+        if (size < sizeof(ip)) {
+            return;
+        }
+        const size_t ip_header_size = reinterpret_cast<const ip*>(data)->ip_hl * 4;
+        auto header = reinterpret_cast<const icmp_ttl_exceeded*>(data + ip_header_size);
+
+        if (size == ip_header_size + sizeof(icmp_ttl_exceeded) &&
+            address(address_v4(*reinterpret_cast<const address_v4::bytes_type*>(&header->ip_header.ip_dst))) == args.icmp_echo_destination() &&
+            header->icmp.type == ICMP_TIME_EXCEEDED)
+        {
+            ProxyClient::Id client_id; // TODO ctor
+            client_id.address = sender;
+            client_id.flow_id = ntohs(header->original_icmp.un.echo.id);
+            client_id.client_port = ntohs(header->original_icmp.un.echo.sequence);
+            icmp_matched.add();
+            add_client(client_id);
+        }
+    }
+}
+
 void ProxyServer::add_client(ProxyClient::Id& id) {
-    if (m_clients.find(id) == m_clients.end()) {
+    boost::lock_guard<boost::mutex> guard(m_clients_lock);
+    ClientKey key(id.address, id.flow_id, id.client_port);
+    if (!m_clients.find(key)) {
         BOOST_LOG_TRIVIAL(info) << "Accepting new proxy client: ip=" << id.address << " flow=" << id.flow_id << " port=" << id.client_port << endl;
         try {
-        m_clients[id] = new ProxyClient(*this, m_io_service, m_udt_service, id);
+            // the UDT connections of a striped flow share their strand
+            ClientKey flow_key(id.address, id.flow_id, 0);
+            auto flow = m_flows.find(flow_key);
+            auto strand = flow ? flow->strand : make_shared<asio::io_service::strand>(m_io_service);
+
+            m_clients.insert(key, new ProxyClient(*this, m_io_service, *strand, m_udt_services, id));
+            if (flow) {
+                flow->clients++;
+            }
+            else {
+                FlowEntry entry = {strand, 1};
+                m_flows.insert(flow_key, entry);
+            }
         }
         catch (const exception& e) {
             BOOST_LOG_TRIVIAL(error) << "Failed to create client: " << e.what() << endl;
@@ -145,6 +261,44 @@ void ProxyServer::add_client(ProxyClient::Id& id) {
 }
 
 void ProxyServer::kill_client(ProxyClient& client) {
-    m_clients.erase(client.id());
+    {
+        boost::lock_guard<boost::mutex> guard(m_clients_lock);
+        auto& id = client.id();
+        if (m_clients.erase(ClientKey(id.address, id.flow_id, id.client_port))) {
+            ClientKey flow_key(id.address, id.flow_id, 0);
+            auto flow = m_flows.find(flow_key);
+            if (flow && --flow->clients == 0) {
+                m_flows.erase(flow_key);
+            }
+        }
+
+        auto group = m_stripe_groups.find(FlowKey(client.id().address, client.id().flow_id));
+        if (group != m_stripe_groups.end()) {
+            auto& clients = group->second;
+            clients.erase(remove(clients.begin(), clients.end(), &client), clients.end());
+            if (clients.empty()) {
+                m_stripe_groups.erase(group);
+            }
+        }
+    }
     delete &client;
 }
+
+EndpointCache& ProxyServer::remote_endpoints() {
+    return m_remote_endpoints;
+}
+
+bool ProxyServer::join_stripe(ProxyClient& client, u_int16_t stripe_count, vector<ProxyClient*>& others) {
+    boost::lock_guard<boost::mutex> guard(m_clients_lock);
+    FlowKey key(client.id().address, client.id().flow_id);
+    auto& clients = m_stripe_groups[key];
+    if (clients.size() + 1 < stripe_count) {
+        clients.push_back(&client);
+        return false;
+    }
+    else {
+        others = clients;
+        m_stripe_groups.erase(key);
+        return true;
+    }
+}
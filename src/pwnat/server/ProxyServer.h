@@ -20,34 +20,75 @@
 #pragma once
 
 #include <pwnat/Application.h>
-#include <boost/array.hpp> // TODO use std instead
+#include <boost/thread.hpp>
 #include "ProxyClient.h"
+#include "ClientIndex.h"
+#include <pwnat/EndpointCache.h>
+#include <pwnat/ProbeSchedule.h>
+#include <pwnat/ReceiveBatch.h>
 
 /**
  * Listens for new ProxyClients using pwnat ICMP trickery
  */
 class ProxyServer : public Application {
+public:
+    static const size_t receive_batch_size = 64; // max packets received per readiness event
+    static const size_t receive_slot_size = 1500; // bytes per packet, larger packets are dropped
+
 public:
     ProxyServer(const ProgramArgs&);
     ~ProxyServer();
 
+    /**
+     * Thread safe
+     */
     void kill_client(ProxyClient&);
 
+    /**
+     * Add client to the stripe group of its flow. Thread safe
+     *
+     * Returns true when stripe_count clients have joined, others is then set
+     * to the other clients of the group and the group is forgotten.
+     */
+    bool join_stripe(ProxyClient&, u_int16_t stripe_count, std::vector<ProxyClient*>& others);
+
+    /**
+     * Endpoints of remote hosts that last accepted a connection
+     */
+    EndpointCache& remote_endpoints();
+
 private:
     void send_icmp_echo();
     void handle_send(const boost::system::error_code& error);
+    void attach_filter();
     void start_receive();
-    void handle_receive(boost::system::error_code error, size_t bytes_transferred);
+    void handle_receive(boost::system::error_code error);
+    void handle_packet(const char* data, size_t size, const boost::asio::ip::address& sender);
     void handle_icmp_timer_expired(const boost::system::error_code& error);
     void add_client(ProxyClient::Id& id);
 
 private:
+    boost::asio::io_service::strand m_strand; // strand of the icmp handlers
     boost::asio::ip::icmp::socket m_socket;
     boost::asio::deadline_timer m_icmp_timer;
-    boost::array<char, 64 * 1024> m_receive_buffer;
+    const ProbeSchedule m_probe_schedule;
+    size_t m_icmp_echoes_sent;
     std::vector<char> m_icmp_echo;
-    boost::asio::ip::icmp::endpoint m_endpoint; // sender endpoint of last received icmp packet
+    EndpointCache m_remote_endpoints;
+
+    ReceiveBatch m_receive_batch; // to receive icmp packets into
+
+    typedef std::pair<boost::asio::ip::address, u_int16_t> FlowKey; // address and flow_id of a client
+
+    // strand shared by the clients of a flow
+    struct FlowEntry {
+        std::shared_ptr<boost::asio::io_service::strand> strand;
+        size_t clients;
+    };
 
-    std::map<ProxyClient::Id, ProxyClient*> m_clients;
+    boost::mutex m_clients_lock; // guards the members below
+    ClientIndex<ProxyClient*> m_clients;
+    ClientIndex<FlowEntry> m_flows; // keyed by address and flow_id, client_port 0
+    std::map<FlowKey, std::vector<ProxyClient*>> m_stripe_groups; // incomplete stripe groups
 };
 
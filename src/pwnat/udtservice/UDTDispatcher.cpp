@@ -19,6 +19,7 @@
 
 #include "UDTDispatcher.h"
 #include <iostream>
+#include <cassert>
 #include <boost/log/trivial.hpp>
 
 #include <pwnat/namespaces.h>
@@ -31,8 +32,20 @@ UDTDispatcher::UDTDispatcher(asio::io_service& io_service, UDTEventPoller& event
 }
 
 void UDTDispatcher::request_register(UDTSOCKET socket, Callback callback) {
-    boost::lock_guard<boost::mutex> guard(m_requests_lock);
-    m_requests.push_back(make_pair(socket, callback));
+    assert(callback);
+    {
+        boost::lock_guard<boost::mutex> guard(m_requests_lock);
+        m_requests.push_back(make_pair(socket, callback));
+    }
+    m_event_poller.wake();
+}
+
+void UDTDispatcher::request_unregister(UDTSOCKET socket) {
+    {
+        boost::lock_guard<boost::mutex> guard(m_requests_lock);
+        m_requests.push_back(make_pair(socket, Callback()));
+    }
+    m_event_poller.wake();
 }
 
 void UDTDispatcher::register_(UDTSOCKET socket, Callback callback) {
@@ -47,7 +60,7 @@ void UDTDispatcher::register_(UDTSOCKET socket, Callback callback) {
 
 void UDTDispatcher::unregister(UDTSOCKET socket) {
     try {
-        m_event_poller.remove(socket);
+        m_event_poller.remove(socket, m_event);
     }
     catch (const UDTEventPoller::Exception& e) {
         BOOST_LOG_TRIVIAL(warning) << "Warning: " << e.what() << endl;
@@ -55,27 +68,29 @@ void UDTDispatcher::unregister(UDTSOCKET socket) {
     m_callbacks.erase(socket);
 }
 
-void UDTDispatcher::reregister(UDTSOCKET socket) {
-    if (m_callbacks.find(socket) != m_callbacks.end()) {
-        try {
-            m_event_poller.add(socket, m_event);
-        }
-        catch (const UDTEventPoller::Exception& e) {
-            BOOST_LOG_TRIVIAL(warning) << "Warning: " << e.what() << endl;
-        }
+bool UDTDispatcher::dispatch(UDTSOCKET socket) {
+    auto it = m_callbacks.find(socket);
+    if (it == m_callbacks.end()) {
+        return false;  // still handling previous event
+    }
+    else {
+        m_io_service.dispatch(it->second);
+        m_callbacks.erase(it);
+        return true;
     }
 }
 
-void UDTDispatcher::dispatch(UDTSOCKET socket) {
-    m_io_service.dispatch(m_callbacks.at(socket));
-    unregister(socket);
-}
-
-void UDTDispatcher::process_requests() {
+size_t UDTDispatcher::process_requests() {
     boost::lock_guard<boost::mutex> guard(m_requests_lock);
+    size_t requests = m_requests.size();
     for (auto request : m_requests) {
-        register_(request.first, request.second);
+        if (request.second) {
+            register_(request.first, request.second);
+        }
+        else {
+            unregister(request.first);
+        }
     }
     m_requests.clear();
+    return requests;
 }
-
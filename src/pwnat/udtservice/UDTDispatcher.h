@@ -29,9 +29,15 @@ class UDTSocket;
 /**
  * Dispatches one kind of UDT event to UDTSockets
  *
- * request_register and process_requests are thread safe. The other methods are
- * not, though they can safely be called while other threads are calling
- * request_register, process_requests.
+ * A registered socket is dispatched to once per registration, but stays
+ * interested in the event in the poller until it's unregistered. This way a
+ * socket that registers again after handling its event doesn't cause changes to
+ * the poll set.
+ *
+ * request_register, request_unregister and process_requests are thread safe.
+ * The request methods wake up the poller so that the request is processed
+ * without delay. The other methods are not thread safe, though they can safely
+ * be called while other threads are calling the thread safe methods.
  */
 class UDTDispatcher {
 public:
@@ -40,28 +46,30 @@ public:
 public:
     UDTDispatcher(boost::asio::io_service&, UDTEventPoller&, EPOLLOpt);
 
-    void request_register(UDTSOCKET socket, Callback callback);
-
     /**
-     * Process registration requests
+     * Request a callback on the next event
      */
-    void process_requests();
+    void request_register(UDTSOCKET socket, Callback callback);
 
     /**
-     * Register socket again with underlying poller/services
+     * Request to no longer be interested in the event
      */
-    void reregister(UDTSOCKET);
+    void request_unregister(UDTSOCKET socket);
 
     /**
-     * Dispatch event to socket, and unregister socket
+     * Process registration requests
      *
-     * Side-effect: if other dispatchers are using this socket, you must reregister the socket with them
+     * Returns number of requests processed
      */
-    void dispatch(UDTSOCKET);
+    size_t process_requests();
 
     /**
-     * Side-effect: if other dispatchers are using this socket, you must reregister the socket with them
+     * Dispatch event to socket, if it's registered for a callback
+     *
+     * Returns true if dispatched.
      */
+    bool dispatch(UDTSOCKET);
+
     void unregister(UDTSOCKET);
 
 private:
@@ -72,11 +80,10 @@ private:
 
 private:
     boost::asio::io_service& m_io_service;
-    UDTEventPoller m_event_poller;
+    UDTEventPoller& m_event_poller;
     const EPOLLOpt m_event;
-    std::map<UDTSOCKET, boost::function<void()>> m_callbacks;
+    std::map<UDTSOCKET, Callback> m_callbacks; // sockets waiting for an event
 
     boost::mutex m_requests_lock;
-    std::vector<std::pair<UDTSOCKET, Callback>> m_requests;
+    std::vector<std::pair<UDTSOCKET, Callback>> m_requests; // Callback() for unregister requests
 };
-
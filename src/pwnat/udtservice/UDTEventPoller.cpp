@@ -19,6 +19,11 @@
 
 #include "UDTEventPoller.h"
 #include <iostream>
+#include <cerrno>
+#include <cstring>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
 #include <pwnat/util.h>
 #include <boost/log/trivial.hpp>
 
@@ -31,32 +36,99 @@ UDTEventPoller::UDTEventPoller()
         BOOST_LOG_TRIVIAL(fatal) << "epoll_create failed" << endl;
         abort();
     }
+
+    if (pipe(m_wakeup_pipe) < 0) {
+        BOOST_LOG_TRIVIAL(fatal) << "Failed to create wakeup pipe: " << strerror(errno) << endl;
+        abort();
+    }
+    fcntl(m_wakeup_pipe[0], F_SETFL, O_NONBLOCK);
+    fcntl(m_wakeup_pipe[1], F_SETFL, O_NONBLOCK);
+
+    int events = UDT_EPOLL_IN;
+    if (UDT::epoll_add_ssock(m_poll_id, m_wakeup_pipe[0], &events) < 0) {
+        BOOST_LOG_TRIVIAL(fatal) << format_udt_error("epoll_add_ssock failed") << endl;
+        abort();
+    }
 }
 
 UDTEventPoller::~UDTEventPoller() {
+    UDT::epoll_remove_ssock(m_poll_id, m_wakeup_pipe[0]);
     UDT::epoll_release(m_poll_id);
+    close(m_wakeup_pipe[0]);
+    close(m_wakeup_pipe[1]);
 }
 
 void UDTEventPoller::udt_throw(string method_name) {
     throw Exception(format_udt_error(method_name));
 }
 
+const int UDTEventPoller::timeout_ms;
+
 void UDTEventPoller::wait(set<UDTSOCKET>& receive_events, set<UDTSOCKET>& send_events) {
-    const int64_t timeout_ms = 100;
-    if (UDT::epoll_wait(m_poll_id, &receive_events, &send_events, timeout_ms) < 0) {
+    set<SYSSOCKET> system_receive_events;
+    int result = UDT::epoll_wait(m_poll_id, &receive_events, &send_events, timeout_ms, &system_receive_events);
+
+    if (!system_receive_events.empty()) {
+        drain_wakeup_pipe();
+    }
+
+    if (result < 0) {
         udt_throw("epoll_wait");
     }
 }
 
-void UDTEventPoller::add(const UDTSOCKET socket, int events) {
-    if (UDT::epoll_add_usock(m_poll_id, socket, &events) < 0) {
-        udt_throw("epoll_add_usock");
+void UDTEventPoller::wait_for_wake() {
+    pollfd fd;
+    fd.fd = m_wakeup_pipe[0];
+    fd.events = POLLIN;
+    if (poll(&fd, 1, timeout_ms) > 0) {
+        drain_wakeup_pipe();
+    }
+}
+
+void UDTEventPoller::drain_wakeup_pipe() {
+    char buffer[64];
+    while (read(m_wakeup_pipe[0], buffer, sizeof(buffer)) > 0);
+}
+
+void UDTEventPoller::wake() {
+    const char byte = 0;
+    if (write(m_wakeup_pipe[1], &byte, 1) < 0 && errno != EAGAIN) {  // EAGAIN: pipe full, so a wake is pending anyway
+        BOOST_LOG_TRIVIAL(warning) << "Warning: failed to wake UDT event poller: " << strerror(errno) << endl;
     }
 }
 
-void UDTEventPoller::remove(const UDTSOCKET socket) {
-    if (UDT::epoll_remove_usock(m_poll_id, socket) < 0) {
-        udt_throw("epoll_remove_usock");
+void UDTEventPoller::add(const UDTSOCKET socket, int events) {
+    auto it = m_events.find(socket);
+    set_events(socket, (it == m_events.end() ? 0 : it->second) | events);
+}
+
+void UDTEventPoller::remove(const UDTSOCKET socket, int events) {
+    auto it = m_events.find(socket);
+    if (it != m_events.end()) {
+        set_events(socket, it->second & ~events);
     }
 }
 
+void UDTEventPoller::set_events(const UDTSOCKET socket, int events) {
+    auto it = m_events.find(socket);
+    int current_events = it == m_events.end() ? 0 : it->second;
+    if (events == current_events) return;
+
+    if (current_events & ~events) {
+        // UDT can't remove single events, remove the socket and add what's left
+        m_events.erase(socket);
+        if (UDT::epoll_remove_usock(m_poll_id, socket) < 0) {
+            udt_throw("epoll_remove_usock");
+        }
+        if (!events) return;
+        current_events = 0;
+    }
+
+    // Note: epoll_add_usock on a socket that's already in the set adds to its events
+    int added_events = events & ~current_events;
+    if (UDT::epoll_add_usock(m_poll_id, socket, &added_events) < 0) {
+        udt_throw("epoll_add_usock");
+    }
+    m_events[socket] = events;
+}
@@ -20,12 +20,20 @@
 #pragma once
 
 #include <stdexcept>
+#include <map>
+#include <boost/noncopyable.hpp>
 #include <udt/udt.h>
 
 /**
  * OO wrapper around UDT epoll functions
+ *
+ * Has a self-pipe registered with the poll set so that other threads can
+ * interrupt wait() with wake().
+ *
+ * Keeps the set of events each socket is interested in, and only touches the
+ * UDT poll set when that interest changes.
  */
-class UDTEventPoller {
+class UDTEventPoller : boost::noncopyable {
 public:
     class Exception : public std::runtime_error {
     public:
@@ -48,13 +56,42 @@ public:
      */
     void wait(std::set<UDTSOCKET>& receive_events, std::set<UDTSOCKET>& send_events);
 
+    /**
+     * Make a current or next call to wait return as soon as possible
+     *
+     * Thread safe.
+     */
+    void wake();
+
+    /**
+     * Block until wake is called, times out after a while
+     */
+    void wait_for_wake();
+
+    /**
+     * Add events to the events socket is interested in
+     */
     void add(const UDTSOCKET socket, int events);
-    void remove(const UDTSOCKET socket);
+
+    /**
+     * Remove events from the events socket is interested in
+     */
+    void remove(const UDTSOCKET socket, int events);
 
 private:
+    /**
+     * Set events socket is interested in, 0 removes the socket from the poll set
+     */
+    void set_events(const UDTSOCKET socket, int events);
+    void drain_wakeup_pipe();
+
     void udt_throw(std::string method_name);
 
 private:
+    static const int timeout_ms = 100;
+
     int m_poll_id;
+    int m_wakeup_pipe[2]; // read end, write end
+    std::map<UDTSOCKET, int> m_events; // events each socket in the poll set is interested in
 };
 
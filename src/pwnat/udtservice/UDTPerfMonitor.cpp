@@ -0,0 +1,151 @@
+/*
+ * Copyright (C) 2013 by Tim Diels
+ *
+ * This file is part of pwnat.
+ *
+ * pwnat is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * pwnat is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with pwnat.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "UDTPerfMonitor.h"
+#include <csignal>
+#include <iomanip>
+#include <boost/bind.hpp>
+#include <pwnat/UDTSocket.h>
+#include <pwnat/metrics/Counter.h>
+#include <boost/log/trivial.hpp>
+
+#include <pwnat/namespaces.h>
+
+static Counter send_loss("pwnat_udt_send_loss_packets_total", "Packets UDT reported lost while sending");
+static Counter receive_loss("pwnat_udt_receive_loss_packets_total", "Packets UDT reported lost while receiving");
+static Counter retransmitted("pwnat_udt_retransmitted_packets_total", "Packets UDT retransmitted");
+
+const size_t UDTPerfMonitor::history_size;
+
+static ostream& operator<<(ostream& out, const UDTPerfMonitor::Sample& sample) {
+    return out << fixed << setprecision(1)
+               << "rtt=" << sample.rtt << "ms"
+               << " bandwidth=" << sample.bandwidth << "Mbps"
+               << " send=" << sample.send_rate << "Mbps"
+               << " receive=" << sample.receive_rate << "Mbps"
+               << " loss=" << sample.send_loss << "/" << sample.receive_loss
+               << " retransmitted=" << sample.retransmitted
+               << " sent=" << sample.bytes_sent << "B"
+               << " received=" << sample.bytes_received << "B"
+               << " buffered=" << sample.send_buffer_size << "/" << sample.receive_buffer_size << "B";
+}
+
+UDTPerfMonitor::UDTPerfMonitor(asio::io_service& io_service, long interval) :
+    m_interval(interval),
+    m_timer(io_service),
+    m_signals(io_service)
+{
+    if (m_interval > 0) {
+        m_signals.add(SIGUSR1);
+        start_signal_wait();
+        start_timer();
+    }
+}
+
+void UDTPerfMonitor::add(shared_ptr<UDTSocket> socket, string description) {
+    if (m_interval <= 0) return;
+
+    boost::lock_guard<boost::mutex> guard(m_lock);
+    Entry entry = {socket, description, vector<Sample>(), 0, socket->bytes_sent(), socket->bytes_received()};
+    entry.history.reserve(history_size);
+    m_entries.push_back(move(entry));
+}
+
+void UDTPerfMonitor::start_timer() {
+    m_timer.expires_from_now(boost::posix_time::seconds(m_interval));
+    m_timer.async_wait(bind(&UDTPerfMonitor::handle_timer_expired, this, asio::placeholders::error));
+}
+
+void UDTPerfMonitor::handle_timer_expired(const boost::system::error_code& error) {
+    if (error) {
+        return;  // cancelled
+    }
+    sample();
+    start_timer();
+}
+
+void UDTPerfMonitor::start_signal_wait() {
+    m_signals.async_wait(bind(&UDTPerfMonitor::handle_signal, this, asio::placeholders::error));
+}
+
+void UDTPerfMonitor::handle_signal(const boost::system::error_code& error) {
+    if (error) {
+        return;  // cancelled
+    }
+    dump();
+    start_signal_wait();
+}
+
+void UDTPerfMonitor::sample() {
+    boost::lock_guard<boost::mutex> guard(m_lock);
+    for (auto it = m_entries.begin(); it != m_entries.end();) {
+        auto& entry = *it;
+        auto socket = entry.socket.lock();
+        UDT::TRACEINFO info;
+        if (!socket || !socket->get_performance(info)) {
+            it = m_entries.erase(it);
+            continue;
+        }
+
+        Sample sample;
+        sample.rtt = info.msRTT;
+        sample.bandwidth = info.mbpsBandwidth;
+        sample.send_rate = info.mbpsSendRate;
+        sample.receive_rate = info.mbpsRecvRate;
+        sample.send_loss = info.pktSndLoss;
+        sample.receive_loss = info.pktRcvLoss;
+        sample.retransmitted = info.pktRetrans;
+
+        auto bytes_sent = socket->bytes_sent();
+        auto bytes_received = socket->bytes_received();
+        sample.bytes_sent = bytes_sent - entry.bytes_sent;
+        sample.bytes_received = bytes_received - entry.bytes_received;
+        entry.bytes_sent = bytes_sent;
+        entry.bytes_received = bytes_received;
+        sample.send_buffer_size = socket->reported_send_buffer_size();
+        sample.receive_buffer_size = socket->reported_receive_buffer_size();
+
+        send_loss.add(sample.send_loss);
+        receive_loss.add(sample.receive_loss);
+        retransmitted.add(sample.retransmitted);
+        BOOST_LOG_TRIVIAL(info) << entry.description << ": " << sample << endl;
+
+        if (entry.history.size() < history_size) {
+            entry.history.push_back(sample);
+        }
+        else {
+            entry.history[entry.next_sample] = sample;
+            entry.next_sample = (entry.next_sample + 1) % history_size;
+        }
+        ++it;
+    }
+}
+
+void UDTPerfMonitor::dump() {
+    boost::lock_guard<boost::mutex> guard(m_lock);
+    BOOST_LOG_TRIVIAL(info) << "UDT performance of " << m_entries.size() << " connections, oldest sample first, every " << m_interval << "s:" << endl;
+    for (auto& entry : m_entries) {
+        stringstream str;
+        str << entry.description << ":" << endl;
+        for (size_t i = 0; i < entry.history.size(); i++) {
+            str << "  " << entry.history.at((entry.next_sample + i) % entry.history.size()) << endl;
+        }
+        BOOST_LOG_TRIVIAL(info) << str.str();
+    }
+}
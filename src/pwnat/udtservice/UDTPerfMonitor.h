@@ -0,0 +1,103 @@
+/*
+ * Copyright (C) 2013 by Tim Diels
+ *
+ * This file is part of pwnat.
+ *
+ * pwnat is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * pwnat is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with pwnat.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <memory>
+#include <string>
+#include <vector>
+#include <boost/asio.hpp>
+#include <boost/thread.hpp>
+
+class UDTSocket;
+
+/**
+ * Periodically samples UDT's performance statistics of each connected UDTSocket
+ *
+ * Along with them, the bytes the socket sent and received since the previous
+ * sample and the size of its send and receive buffers, so each tunnel's
+ * traffic can be told apart without a metrics series per tunnel.
+ *
+ * Keeps a short history per socket. Each sample is logged at info level, the
+ * histories of all sockets are logged on SIGUSR1. Losses and retransmissions
+ * are added to the metrics.
+ *
+ * Thread safe.
+ */
+class UDTPerfMonitor {
+public:
+    static const size_t history_size = 32; // samples kept per socket
+
+    struct Sample {
+        float rtt; // ms
+        float bandwidth; // estimated, Mbps
+        float send_rate; // Mbps
+        float receive_rate; // Mbps
+        u_int32_t send_loss; // packets
+        u_int32_t receive_loss; // packets
+        u_int32_t retransmitted; // packets
+        u_int64_t bytes_sent; // since the previous sample
+        u_int64_t bytes_received;
+        u_int32_t send_buffer_size; // bytes, at the time of the sample
+        u_int32_t receive_buffer_size;
+    };
+
+public:
+    /**
+     * interval: seconds between samples, 0 to not sample
+     */
+    UDTPerfMonitor(boost::asio::io_service&, long interval);
+
+    /**
+     * Sample socket until it's destroyed
+     *
+     * description: shown in logs
+     */
+    void add(std::shared_ptr<UDTSocket> socket, std::string description);
+
+    /**
+     * Log the history of each socket
+     */
+    void dump();
+
+private:
+    struct Entry {
+        std::weak_ptr<UDTSocket> socket;
+        std::string description;
+        std::vector<Sample> history; // ring buffer
+        size_t next_sample; // index of the oldest sample, once full
+        u_int64_t bytes_sent; // totals at the previous sample
+        u_int64_t bytes_received;
+    };
+
+private:
+    void start_timer();
+    void handle_timer_expired(const boost::system::error_code& error);
+    void start_signal_wait();
+    void handle_signal(const boost::system::error_code& error);
+    void sample();
+
+private:
+    const long m_interval;
+    boost::asio::deadline_timer m_timer;
+    boost::asio::signal_set m_signals;
+
+    boost::mutex m_lock; // guards the members below
+    std::vector<Entry> m_entries;
+};
@@ -20,12 +20,18 @@
 #include "UDTService.h"
 #include <cassert>
 #include <pwnat/UDTSocket.h>
+#include <pwnat/metrics/Counter.h>
+#include <pwnat/metrics/Histogram.h>
 #include <boost/log/trivial.hpp>
 
 #include <pwnat/namespaces.h>
 
-UDTService::UDTService(asio::io_service& io_service) :
+static Counter udt_events_dispatched("pwnat_udt_events_dispatched_total", "UDT socket events dispatched to sockets");
+static Histogram udt_iteration_time("pwnat_udt_iteration_seconds", "", "Time taken by a UDT service loop iteration, excluding waiting for events");
+
+UDTService::UDTService(asio::io_service& io_service, long stall_threshold) :
     m_stopped(false),
+    m_stall_threshold(stall_threshold),
     m_receive_dispatcher(io_service, m_event_poller, UDT_EPOLL_IN),
     m_send_dispatcher(io_service, m_event_poller, UDT_EPOLL_OUT),
     m_thread(bind(&UDTService::run, this))
@@ -36,13 +42,24 @@ void UDTService::request_receive(UDTSOCKET socket, UDTDispatcher::Callback callb
     m_receive_dispatcher.request_register(socket, callback);
 }
 
+void UDTService::cancel_receive(UDTSOCKET socket) {
+    m_receive_dispatcher.request_unregister(socket);
+}
+
 void UDTService::request_send(UDTSOCKET socket, UDTDispatcher::Callback callback) {
     m_send_dispatcher.request_register(socket, callback);
 }
 
+void UDTService::cancel_send(UDTSOCKET socket) {
+    m_send_dispatcher.request_unregister(socket);
+}
+
 void UDTService::request_unregister(UDTSOCKET socket) {
-    boost::lock_guard<boost::mutex> guard(m_unregister_requests_lock);
-    m_unregister_requests.push_back(socket);
+    {
+        boost::lock_guard<boost::mutex> guard(m_unregister_requests_lock);
+        m_unregister_requests.push_back(socket);
+    }
+    m_event_poller.wake();
 }
 
 void UDTService::run() noexcept {
@@ -58,27 +75,42 @@ void UDTService::run() noexcept {
          * - a socket is returned in send events <=> socket has room for new data in its send buffer (this is called over and over if you'd leave the socket registered to the write event with no data to send)
          */
         while (!m_stopped) {
+            chrono::steady_clock::duration busy_time(0); // time spent in this iteration, excluding waits
+            bool all_handling = false; // whether all events were of sockets still handling a previous event
             try {
                 m_event_poller.wait(receive_events, send_events);
+                auto dispatch_start = chrono::steady_clock::now();
+                int64_t dispatched = 0;
 
                 // Dispatch events to sockets that can read
                 for (auto socket_handle : receive_events) {
-                    m_receive_dispatcher.dispatch(socket_handle);
-                    m_send_dispatcher.reregister(socket_handle);
+                    dispatched += m_receive_dispatcher.dispatch(socket_handle);
                 }
 
                 // Dispatch events to sockets that can write
                 for (auto socket_handle : send_events) {
-                    m_send_dispatcher.dispatch(socket_handle);
-                    m_receive_dispatcher.reregister(socket_handle);
+                    dispatched += m_send_dispatcher.dispatch(socket_handle);
                 }
+                udt_events_dispatched.add(dispatched);
+                busy_time += chrono::steady_clock::now() - dispatch_start;
+                all_handling = !dispatched && !(receive_events.empty() && send_events.empty());
             }
             catch (const UDTEventPoller::Exception& e) {
                 BOOST_LOG_TRIVIAL(warning) << "Warning: " << e.what() << endl;
             }
 
             // Process pending requests
-            process_requests();
+            auto requests_start = chrono::steady_clock::now();
+            size_t requests = process_requests();
+            busy_time += chrono::steady_clock::now() - requests_start;
+            record_iteration(busy_time);
+
+            if (all_handling && !requests) {
+                // Instead of spinning on the events, wait for the sockets to
+                // register again. Note: wait() drained the wakeup pipe, so
+                // requests made before it are only seen by process_requests
+                m_event_poller.wait_for_wake();
+            }
         }
 
         BOOST_LOG_TRIVIAL(debug) << "UDT service thread stopped" << endl;
@@ -93,19 +125,29 @@ void UDTService::run() noexcept {
     abort();
 }
 
-void UDTService::process_requests() {
-    m_receive_dispatcher.process_requests();
-    m_send_dispatcher.process_requests();
+void UDTService::record_iteration(chrono::steady_clock::duration duration) {
+    udt_iteration_time.record(duration);
+    if (m_stall_threshold.count() && duration >= m_stall_threshold) {
+        BOOST_LOG_TRIVIAL(warning) << "Warning: UDT service thread stalled for " << chrono::duration_cast<chrono::milliseconds>(duration).count() << " ms" << endl;
+    }
+}
+
+size_t UDTService::process_requests() {
+    size_t requests = m_receive_dispatcher.process_requests();
+    requests += m_send_dispatcher.process_requests();
 
     boost::lock_guard<boost::mutex> guard(m_unregister_requests_lock);
     for (auto socket : m_unregister_requests) {
         m_receive_dispatcher.unregister(socket);
         m_send_dispatcher.unregister(socket);
     }
+    requests += m_unregister_requests.size();
     m_unregister_requests.clear();
+    return requests;
 }
 
 void UDTService::stop() {
     m_stopped = true;
+    m_event_poller.wake();
 }
 
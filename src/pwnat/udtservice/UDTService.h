@@ -19,6 +19,7 @@
 
 #pragma once
 
+#include <chrono>
 #include <boost/asio.hpp>
 #include <boost/thread.hpp>
 #include "UDTEventPoller.h"
@@ -29,26 +30,39 @@ class UDTSocket;
 /**
  * Polls for UDT events and dispatches io_service events
  *
- * Note: should be used as a singleton
+ * Note: use through UDTServicePool
  */
 class UDTService {
 public:
-    UDTService(boost::asio::io_service& io_service);
+    /**
+     * stall_threshold: ms a loop iteration may take before a warning is logged, 0 to never warn
+     */
+    UDTService(boost::asio::io_service& io_service, long stall_threshold);
 
     /**
      * Notify UDTService that socket wants to receive data.
      *
-     * UDTService will call the callback once (or twice) when there is data to receive with recv()
+     * UDTService will call the callback once when there is data to receive with recv()
      */
     void request_receive(UDTSOCKET socket, UDTDispatcher::Callback callback);
 
+    /**
+     * Notify UDTService that socket no longer wants to receive data
+     */
+    void cancel_receive(UDTSOCKET socket);
+
     /**
      * Notify UDTService that socket wants to send
      *
-     * UDTService will call the callback once (or twice) when there is room in buffer to send some data with send()
+     * UDTService will call the callback once when there is room in buffer to send some data with send()
      */
     void request_send(UDTSOCKET socket, UDTDispatcher::Callback callback);
 
+    /**
+     * Notify UDTService that socket no longer wants to send, e.g. because it has nothing left to send
+     */
+    void cancel_send(UDTSOCKET socket);
+
     /**
      * Unregister from all 
      */
@@ -58,10 +72,12 @@ public:
 
 private:
     void run() noexcept;
-    void process_requests();
+    size_t process_requests(); // returns number of requests processed
+    void record_iteration(std::chrono::steady_clock::duration);
 
 private:
     bool m_stopped;
+    const std::chrono::milliseconds m_stall_threshold;
     UDTEventPoller m_event_poller;
     UDTDispatcher m_receive_dispatcher;
     UDTDispatcher m_send_dispatcher;
@@ -0,0 +1,63 @@
+/*
+ * Copyright (C) 2013 by Tim Diels
+ *
+ * This file is part of pwnat.
+ *
+ * pwnat is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * pwnat is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with pwnat.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "UDTServicePool.h"
+#include <cassert>
+#include <boost/log/trivial.hpp>
+
+#include <pwnat/namespaces.h>
+
+UDTServicePool::UDTServicePool(asio::io_service& io_service, size_t service_count, long stall_threshold) {
+    assert(service_count > 0);
+
+    // each service gets multiple points on the ring to even out the distribution
+    const u_int32_t points_per_service = 64;
+    for (size_t i = 0; i < service_count; ++i) {
+        m_services.push_back(unique_ptr<UDTService>(new UDTService(io_service, stall_threshold)));
+        for (u_int32_t point = 0; point < points_per_service; ++point) {
+            m_ring[hash(i * points_per_service + point)] = m_services.back().get();
+        }
+    }
+
+    BOOST_LOG_TRIVIAL(debug) << "Started " << service_count << " UDT service threads" << endl;
+}
+
+UDTService& UDTServicePool::get(UDTSOCKET socket) {
+    auto it = m_ring.lower_bound(hash(socket));
+    if (it == m_ring.end()) {
+        it = m_ring.begin();
+    }
+    return *it->second;
+}
+
+void UDTServicePool::stop() {
+    for (auto& service : m_services) {
+        service->stop();
+    }
+}
+
+u_int32_t UDTServicePool::hash(u_int32_t value) {
+    // murmur3 finalizer
+    value ^= value >> 16;
+    value *= 0x85ebca6b;
+    value ^= value >> 13;
+    value *= 0xc2b2ae35;
+    value ^= value >> 16;
+    return value;
+}
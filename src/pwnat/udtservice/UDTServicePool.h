@@ -0,0 +1,57 @@
+/*
+ * Copyright (C) 2013 by Tim Diels
+ *
+ * This file is part of pwnat.
+ *
+ * pwnat is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * pwnat is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with pwnat.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <map>
+#include <memory>
+#include <vector>
+#include <boost/asio.hpp>
+#include <boost/noncopyable.hpp>
+#include "UDTService.h"
+
+/**
+ * Spreads UDT sockets over multiple UDTServices, each with its own thread
+ *
+ * Sockets are assigned to a service by consistent hashing of their UDTSOCKET.
+ */
+class UDTServicePool : boost::noncopyable {
+public:
+    /**
+     * service_count: number of UDTServices (and thus threads) to start
+     * stall_threshold: see UDTService
+     */
+    UDTServicePool(boost::asio::io_service& io_service, size_t service_count, long stall_threshold);
+
+    /**
+     * Get service that handles given socket
+     *
+     * Always returns the same service for the same socket.
+     */
+    UDTService& get(UDTSOCKET socket);
+
+    void stop();
+
+private:
+    static u_int32_t hash(u_int32_t value);
+
+private:
+    std::vector<std::unique_ptr<UDTService>> m_services;
+    std::map<u_int32_t, UDTService*> m_ring; // hash ring: point on ring -> service
+};
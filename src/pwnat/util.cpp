@@ -18,10 +18,15 @@
  */
 
 #include "util.h"
+#include "ChunkBuffer.h"
+#include "AbstractSocket.h"
+#include "packet.h"
 
 #include <udt/udt.h>
 #include <iomanip>
 #include <sstream>
+#include <vector>
+#include <cstring>
 
 #include <pwnat/namespaces.h>
 
@@ -76,8 +81,24 @@ string get_hex_dump(const unsigned char *data, int len)
     return out.str();
 }
 
+string get_hex_dump(const ChunkBuffer& buffer) {
+    vector<unsigned char> data(buffer.size());
+    buffer.copy(reinterpret_cast<char*>(data.data()), data.size());
+    return get_hex_dump(data.data(), data.size());
+}
+
 string format_udt_error(string prefix) {
     stringstream str;
     str << prefix << ": " << UDT::getlasterror().getErrorMessage();
     return str.str();
 }
+
+void send_udt_flow_init(AbstractSocket& socket, const string& remote_host, u_int16_t remote_port) {
+    u_int16_t size = sizeof(udt_flow_init) + remote_host.length();
+    vector<char> buffer(size);
+    udt_flow_init& flow_init = *reinterpret_cast<udt_flow_init*>(buffer.data());
+    flow_init.size = size;
+    flow_init.remote_port = remote_port;
+    memcpy(buffer.data() + sizeof(udt_flow_init), remote_host.data(), remote_host.length());
+    socket.send(buffer.data(), buffer.size());
+}
@@ -20,6 +20,16 @@
 #pragma once
 
 #include <string>
+#include <sys/types.h>
+
+class ChunkBuffer;
+class AbstractSocket;
 
 std::string get_hex_dump(const unsigned char *data, int len);
+std::string get_hex_dump(const ChunkBuffer& buffer);
 std::string format_udt_error(std::string prefix);
+
+/**
+ * Send udt_flow_init onto socket
+ */
+void send_udt_flow_init(AbstractSocket& socket, const std::string& remote_host, u_int16_t remote_port);
@@ -0,0 +1,245 @@
+/*
+ * Copyright (C) 2013 by Tim Diels
+ *
+ * This file is part of pwnat.
+ *
+ * pwnat is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * pwnat is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with pwnat.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <iostream>
+#include <map>
+#include <string>
+#include <sstream>
+#include <boost/asio.hpp>
+#include <boost/thread.hpp>
+#include <boost/log/core.hpp>
+#include <boost/log/expressions.hpp>
+#include <boost/log/trivial.hpp>
+#include <pwnat/CachingResolver.h>
+
+using namespace std;
+namespace asio = boost::asio;
+
+static int failures = 0;
+
+static void check(bool ok, const string& what) {
+    if (!ok) {
+        cerr << "FAIL: " << what << endl;
+        failures++;
+    }
+}
+
+/**
+ * Stand-in name server: answers from a fixed zone, counts queries per name and
+ * can hold queries, of all names or of one, until released
+ */
+class NameServer {
+public:
+    NameServer() :
+        m_holding(false)
+    {
+    }
+
+    void add(const string& host, const string& address) {
+        boost::lock_guard<boost::mutex> guard(m_lock);
+        m_zone[host] = asio::ip::address::from_string(address);
+    }
+
+    CachingResolver::Addresses lookup(const string& host, boost::system::error_code& error) {
+        boost::unique_lock<boost::mutex> lock(m_lock);
+        m_queries[host]++;
+        while (m_holding && (m_held_host.empty() || m_held_host == host)) {
+            m_released.wait(lock);
+        }
+
+        CachingResolver::Addresses addresses;
+        auto it = m_zone.find(host);
+        if (it == m_zone.end()) {
+            error = asio::error::host_not_found;
+        }
+        else {
+            addresses.push_back(it->second);
+        }
+        return addresses;
+    }
+
+    int queries(const string& host) {
+        boost::lock_guard<boost::mutex> guard(m_lock);
+        return m_queries[host];
+    }
+
+    /**
+     * host: name to hold queries of, empty to hold all
+     */
+    void hold(const string& host = "") {
+        boost::lock_guard<boost::mutex> guard(m_lock);
+        m_holding = true;
+        m_held_host = host;
+    }
+
+    void release() {
+        boost::lock_guard<boost::mutex> guard(m_lock);
+        m_holding = false;
+        m_released.notify_all();
+    }
+
+private:
+    boost::mutex m_lock;
+    boost::condition_variable m_released;
+    bool m_holding;
+    string m_held_host;
+    map<string, asio::ip::address> m_zone;
+    map<string, int> m_queries;
+};
+
+struct Result {
+    Result() : calls(0) {}
+
+    int calls;
+    boost::system::error_code error;
+    CachingResolver::Addresses addresses;
+};
+
+static CachingResolver::ResolveHandler record(Result& result) {
+    return [&result](boost::system::error_code error, const CachingResolver::Addresses& addresses) {
+        result.calls++;
+        result.error = error;
+        result.addresses = addresses;
+    };
+}
+
+// run handlers until none are left
+static void run(asio::io_service& io_service) {
+    io_service.reset();
+    io_service.run();
+}
+
+static void test_coalescing() {
+    asio::io_service io_service;
+    NameServer server;
+    server.add("example.test", "192.0.2.1");
+    CachingResolver resolver(io_service, bind(&NameServer::lookup, &server, placeholders::_1, placeholders::_2));
+
+    server.hold();
+    vector<Result> results(10);
+    for (auto& result : results) {
+        resolver.async_resolve("example.test", record(result));
+    }
+    server.release();
+
+    while (results.back().calls == 0) {
+        run(io_service);
+    }
+    check(server.queries("example.test") == 1, "concurrent lookups of a name share one query");
+    for (auto& result : results) {
+        check(result.calls == 1 && !result.error && result.addresses.size() == 1 && result.addresses[0].to_string() == "192.0.2.1", "each waiting handler gets the addresses");
+    }
+
+    Result cached;
+    resolver.async_resolve("example.test", record(cached));
+    run(io_service);
+    check(cached.calls == 1 && !cached.error && server.queries("example.test") == 1, "resolved names are cached");
+    check(resolver.resolve("example.test").size() == 1 && server.queries("example.test") == 1, "blocking resolve uses the cache");
+}
+
+static void test_negative_caching() {
+    asio::io_service io_service;
+    NameServer server;
+    CachingResolver resolver(io_service, bind(&NameServer::lookup, &server, placeholders::_1, placeholders::_2));
+
+    Result first;
+    resolver.async_resolve("missing.test", record(first));
+    while (first.calls == 0) {
+        run(io_service);
+    }
+    check(first.error == asio::error::host_not_found, "failed lookup reports its error");
+
+    Result second;
+    resolver.async_resolve("missing.test", record(second));
+    run(io_service);
+    check(second.calls == 1 && second.error == asio::error::host_not_found, "failed lookups are cached");
+    check(server.queries("missing.test") == 1, "cached failure causes no query");
+
+    bool threw = false;
+    try {
+        resolver.resolve("missing.test");
+    }
+    catch (const boost::system::system_error&) {
+        threw = true;
+    }
+    check(threw && server.queries("missing.test") == 1, "blocking resolve throws the cached failure");
+}
+
+static void test_slow_lookup() {
+    asio::io_service io_service;
+    NameServer server;
+    server.add("slow.test", "192.0.2.3");
+    server.add("fast.test", "192.0.2.4");
+    CachingResolver resolver(io_service, bind(&NameServer::lookup, &server, placeholders::_1, placeholders::_2));
+
+    server.hold("slow.test");
+    Result slow;
+    Result fast;
+    resolver.async_resolve("slow.test", record(slow));
+    resolver.async_resolve("fast.test", record(fast));
+    for (int i = 0; i < 2000 && fast.calls == 0; i++) {
+        boost::this_thread::sleep(boost::posix_time::milliseconds(1));
+        run(io_service);
+    }
+    check(fast.calls == 1 && !fast.error && slow.calls == 0, "a held lookup doesn't hold up lookups of other names");
+
+    server.release();
+    while (slow.calls == 0) {
+        run(io_service);
+    }
+    check(!slow.error, "the held lookup completes once released");
+}
+
+static void test_eviction() {
+    asio::io_service io_service;
+    NameServer server;
+    CachingResolver resolver(io_service, bind(&NameServer::lookup, &server, placeholders::_1, placeholders::_2));
+
+    const size_t hosts = CachingResolver::max_entries + 100;
+    for (size_t i = 0; i < hosts; i++) {
+        stringstream host;
+        host << "host" << i << ".test";
+        server.add(host.str(), "192.0.2.2");
+        resolver.resolve(host.str());
+    }
+
+    resolver.resolve("host0.test");
+    check(server.queries("host0.test") == 2, "least recently used entries are evicted beyond max_entries");
+
+    stringstream last;
+    last << "host" << hosts - 1 << ".test";
+    resolver.resolve(last.str());
+    check(server.queries(last.str()) == 1, "recently used entries are kept");
+}
+
+int main() {
+    boost::log::core::get()->set_filter(boost::log::trivial::severity >= boost::log::trivial::warning);
+
+    test_coalescing();
+    test_negative_caching();
+    test_slow_lookup();
+    test_eviction();
+
+    if (failures) {
+        cerr << failures << " checks failed" << endl;
+        return 1;
+    }
+    cout << "All caching resolver tests passed" << endl;
+    return 0;
+}
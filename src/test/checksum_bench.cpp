@@ -0,0 +1,58 @@
+/*
+ * Copyright (C) 2013 by Tim Diels
+ *
+ * This file is part of pwnat.
+ *
+ * pwnat is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * pwnat is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with pwnat.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <chrono>
+#include <iostream>
+#include <vector>
+#include <pwnat/checksum.h>
+#include "reference_checksum.h"
+
+using namespace std;
+
+/**
+ * Throughput of get_checksum against the byte-wise reference, per packet size
+ */
+template <typename Function>
+static double get_throughput(Function checksum, const vector<unsigned char>& buffer, size_t size) {
+    const size_t total_bytes = 256 * 1024 * 1024;
+    size_t iterations = total_bytes / size;
+    volatile uint16_t sink = 0;
+
+    auto start = chrono::steady_clock::now();
+    for (size_t i = 0; i < iterations; i++) {
+        sink = sink + checksum(buffer.data() + (i % 16), size);
+    }
+    chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+    return iterations * size / elapsed.count() / (1024 * 1024);
+}
+
+int main() {
+    vector<unsigned char> buffer(64 * 1024 + 16);
+    for (size_t i = 0; i < buffer.size(); i++) {
+        buffer[i] = static_cast<unsigned char>(i * 131);
+    }
+
+    cout << "size\tget_checksum MiB/s\treference MiB/s" << endl;
+    for (size_t size : {20, 64, 84, 576, 1500, 9000, 64 * 1024}) {
+        double optimized = get_throughput([](const unsigned char* data, size_t bytes) { return get_checksum(data, bytes); }, buffer, size);
+        double reference = get_throughput(get_reference_checksum, buffer, size);
+        cout << size << "\t" << optimized << "\t" << reference << endl;
+    }
+    return 0;
+}
@@ -0,0 +1,110 @@
+/*
+ * Copyright (C) 2013 by Tim Diels
+ *
+ * This file is part of pwnat.
+ *
+ * pwnat is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * pwnat is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with pwnat.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <iostream>
+#include <random>
+#include <vector>
+#include <cstring>
+#include <arpa/inet.h>
+#include <pwnat/checksum.h>
+#include "reference_checksum.h"
+
+using namespace std;
+
+static int failures = 0;
+
+static void check(bool ok, const string& what, size_t offset, size_t size) {
+    if (!ok) {
+        cerr << "FAIL: " << what << " (offset " << offset << ", size " << size << ")" << endl;
+        failures++;
+    }
+}
+
+// checksums are equal in one's complement arithmetic, where 0 and 0xFFFF are both zero
+static bool same_checksum(uint16_t a, uint16_t b) {
+    return a == b || (a == 0 && b == 0xFFFF) || (a == 0xFFFF && b == 0);
+}
+
+static void test_against_reference(const vector<unsigned char>& buffer, size_t offset, size_t size) {
+    const unsigned char* data = buffer.data() + offset;
+    uint16_t expected = get_reference_checksum(data, size);
+    check(htons(get_checksum(data, size)) == expected, "get_checksum differs from reference", offset, size);
+
+    // in even pieces
+    size_t piece = (size / 3) & ~static_cast<size_t>(1);
+    uint64_t sum = add_to_checksum(0, data, piece);
+    sum = add_to_checksum(sum, data + piece, size - piece);
+    check(htons(finish_checksum(sum)) == expected, "checksum in pieces differs from reference", offset, size);
+}
+
+static void test_update(vector<unsigned char>& buffer, size_t offset, size_t size, mt19937& random) {
+    if (size < 2) return;
+    unsigned char* data = buffer.data() + offset;
+    uint16_t checksum = get_checksum(data, size);
+
+    size_t word_offset = (random() % (size / 2)) * 2;
+    uint16_t old_word;
+    memcpy(&old_word, data + word_offset, 2);
+    uint16_t new_word = static_cast<uint16_t>(random());
+    memcpy(data + word_offset, &new_word, 2);
+
+    check(same_checksum(update_checksum(checksum, old_word, new_word), get_checksum(data, size)), "update_checksum differs from recompute", offset, size);
+}
+
+int main() {
+    mt19937 random(1);
+    const size_t max_size = 3 * 1024 * 1024;  // beyond the block size of the vector implementations
+    vector<unsigned char> random_buffer(max_size + 64);
+    for (auto& byte : random_buffer) {
+        byte = static_cast<unsigned char>(random());
+    }
+    vector<unsigned char> ones_buffer(max_size + 64, 0xFF);  // largest sums, catches lane overflow
+
+    vector<size_t> sizes;
+    for (size_t size = 0; size <= 300; size++) {
+        sizes.push_back(size);  // around the scalar/vector cutoffs
+    }
+    for (int i = 0; i < 200; i++) {
+        sizes.push_back(random() % (64 * 1024));
+    }
+    sizes.push_back(1024 * 1024);
+    sizes.push_back(1024 * 1024 + 31);
+    sizes.push_back(max_size);
+
+    for (auto size : sizes) {
+        for (size_t offset : {0, 1, 2, 3, 15, 31}) {
+            test_against_reference(random_buffer, offset, size);
+            test_against_reference(ones_buffer, offset, size);
+        }
+        test_update(random_buffer, random() % 32, size, random);
+        test_update(ones_buffer, random() % 32, size, random);
+        fill(ones_buffer.begin(), ones_buffer.end(), 0xFF);
+    }
+
+    // RFC 1071 example: 00 01 f2 03 f4 f5 f6 f7 sums to ddf2
+    const unsigned char example[] = {0x00, 0x01, 0xf2, 0x03, 0xf4, 0xf5, 0xf6, 0xf7};
+    check(get_reference_checksum(example, sizeof(example)) == static_cast<uint16_t>(~0xddf2), "reference differs from RFC 1071 example", 0, sizeof(example));
+
+    if (failures) {
+        cerr << failures << " checks failed" << endl;
+        return 1;
+    }
+    cout << "All checksum tests passed" << endl;
+    return 0;
+}
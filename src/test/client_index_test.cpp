@@ -0,0 +1,162 @@
+/*
+ * Copyright (C) 2013 by Tim Diels
+ *
+ * This file is part of pwnat.
+ *
+ * pwnat is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * pwnat is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with pwnat.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <cmath>
+#include <iostream>
+#include <map>
+#include <random>
+#include <sstream>
+#include <string>
+#include <tuple>
+#include <vector>
+#include <pwnat/server/ClientIndex.h>
+
+using namespace std;
+namespace asio = boost::asio;
+
+const size_t operation_count = 2000000;
+const size_t compare_interval = 10000; // operations between full comparisons
+
+static int failures = 0;
+
+static void check(bool ok, const string& what) {
+    if (!ok) {
+        cerr << "FAIL: " << what << endl;
+        failures++;
+    }
+}
+
+typedef tuple<asio::ip::address, u_int16_t, u_int16_t> Id;
+
+static ClientKey to_key(const Id& id) {
+    return ClientKey(get<0>(id), get<1>(id), get<2>(id));
+}
+
+/**
+ * Whether index holds exactly the entries of reference
+ */
+static bool same(ClientIndex<int>& index, const map<Id, int>& reference) {
+    if (index.size() != reference.size()) {
+        return false;
+    }
+    for (auto& entry : reference) {
+        auto value = index.find(to_key(entry.first));
+        if (!value || *value != entry.second) {
+            return false;
+        }
+    }
+    size_t visited = 0;
+    index.for_each([&](const ClientKey&, int&) { visited++; });
+    return visited == reference.size();
+}
+
+/**
+ * Random inserts, erases and finds, compared against a std::map
+ *
+ * The key space is small so erases hit, and the insert ratio swings so the
+ * table repeatedly grows and empties, with clusters wrapping around its end.
+ */
+static void test_against_map() {
+    mt19937 random(42);
+    vector<asio::ip::address> addresses;
+    for (int i = 1; i <= 8; i++) {
+        addresses.push_back(asio::ip::address_v4(0x0a000000 + i));
+        addresses.push_back(asio::ip::address_v6::from_string("2001:db8::" + to_string(i)));
+    }
+    uniform_int_distribution<size_t> address(0, addresses.size() - 1);
+    uniform_int_distribution<u_int16_t> flow_id(0, 31);
+    uniform_int_distribution<u_int16_t> client_port(0, 15);
+    uniform_real_distribution<double> unit(0, 1);
+
+    ClientIndex<int> index;
+    map<Id, int> reference;
+    for (size_t i = 0; i < operation_count; i++) {
+        Id id(addresses.at(address(random)), flow_id(random), client_port(random));
+        auto key = to_key(id);
+        double insert_ratio = 0.5 + 0.45 * sin(i / 20000.0);
+        double operation = unit(random);
+        if (operation < insert_ratio) {
+            int value = static_cast<int>(i);
+            bool inserted = index.insert(key, value);
+            check(inserted == reference.insert(make_pair(id, value)).second, "insert");
+        }
+        else if (operation < insert_ratio + (1 - insert_ratio) * 0.8) {
+            check(index.erase(key) == (reference.erase(id) == 1), "erase");
+        }
+        else {
+            auto value = index.find(key);
+            auto it = reference.find(id);
+            check(it == reference.end() ? !value : (value && *value == it->second), "find");
+        }
+
+        if (i % compare_interval == 0) {
+            stringstream what;
+            what << "same entries as std::map after " << i << " operations";
+            check(same(index, reference), what.str());
+        }
+        if (failures) return;
+    }
+    check(same(index, reference), "same entries as std::map at the end");
+}
+
+/**
+ * Erase each entry of a cluster that wraps around the end of the table
+ */
+static void test_wrap_around_erase() {
+    const size_t slot_count = 16;  // initial size of the table, 4 entries don't grow it
+
+    // find 3 keys whose home is the last slot and 1 whose home is the first
+    vector<ClientKey> keys;
+    size_t at_last_slot = 0;
+    for (u_int16_t port = 1; keys.size() < 4; port++) {
+        ClientKey key(asio::ip::address_v4(0x0a000001), 1, port);
+        size_t home = key.hash() & (slot_count - 1);
+        if ((home == slot_count - 1 && at_last_slot < 3) || (home == 0 && keys.size() == 3)) {
+            keys.push_back(key);
+            at_last_slot += home == slot_count - 1;
+        }
+    }
+
+    for (size_t erased = 0; erased < keys.size(); erased++) {
+        ClientIndex<int> index;
+        for (size_t i = 0; i < keys.size(); i++) {
+            index.insert(keys.at(i), static_cast<int>(i));
+        }
+
+        check(index.erase(keys.at(erased)), "erase key of wrapping cluster");
+        for (size_t i = 0; i < keys.size(); i++) {
+            auto value = index.find(keys.at(i));
+            stringstream what;
+            what << "key " << i << " after erasing key " << erased << " of wrapping cluster";
+            check(i == erased ? !value : (value && *value == static_cast<int>(i)), what.str());
+        }
+    }
+}
+
+int main() {
+    test_wrap_around_erase();
+    test_against_map();
+
+    if (failures) {
+        cerr << failures << " checks failed" << endl;
+        return 1;
+    }
+    cout << "All client index tests passed" << endl;
+    return 0;
+}
@@ -0,0 +1,105 @@
+/*
+ * Copyright (C) 2013 by Tim Diels
+ *
+ * This file is part of pwnat.
+ *
+ * pwnat is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * pwnat is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with pwnat.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <iostream>
+#include <memory>
+#include <set>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <boost/thread.hpp>
+#include <pwnat/client/FlowIdAllocator.h>
+
+using namespace std;
+using boost::posix_time::milliseconds;
+
+const size_t id_count = 0xFFFF;  // all but the reserved id 0
+const long quarantine_ms = 200;
+
+static int failures = 0;
+
+static void check(bool ok, const string& what) {
+    if (!ok) {
+        cerr << "FAIL: " << what << endl;
+        failures++;
+    }
+}
+
+static bool exhausted(FlowIdAllocator& allocator) {
+    try {
+        allocator.allocate();
+        return false;
+    }
+    catch (const runtime_error&) {
+        return true;
+    }
+}
+
+static void test_unique() {
+    auto allocator = make_shared<FlowIdAllocator>();
+    vector<shared_ptr<FlowId>> ids;
+    set<u_int16_t> values;
+    for (size_t i = 0; i < 1000; i++) {
+        ids.push_back(allocator->allocate());
+        values.insert(ids.back()->value());
+    }
+    check(values.size() == ids.size(), "ids in use are unique");
+    check(!values.count(0), "id 0 is reserved");
+}
+
+static void test_quarantine() {
+    auto allocator = make_shared<FlowIdAllocator>();
+    set<u_int16_t> values;
+    for (size_t i = 0; i < 1000; i++) {
+        values.insert(allocator->allocate()->value());  // Note: released right away
+    }
+    check(values.size() == 1000, "released ids are not handed out while quarantined");
+}
+
+static void test_exhaustion_and_wrap_around() {
+    auto allocator = make_shared<FlowIdAllocator>(milliseconds(quarantine_ms));
+    vector<shared_ptr<FlowId>> ids;
+    for (size_t i = 0; i < id_count; i++) {
+        ids.push_back(allocator->allocate());
+    }
+    check(exhausted(*allocator), "allocate throws when all ids are in use");
+
+    // release an early id, the next search has to wrap around to find it
+    u_int16_t released = ids.at(9)->value();
+    ids.at(9).reset();
+    check(exhausted(*allocator), "a quarantined id is not handed out when all others are in use");
+
+    boost::this_thread::sleep(milliseconds(quarantine_ms + 100));
+    auto id = allocator->allocate();
+    check(id->value() == released, "the released id is handed out after its quarantine, wrapping around");
+    check(exhausted(*allocator), "allocate throws again once that id is taken");
+}
+
+int main() {
+    test_unique();
+    test_quarantine();
+    test_exhaustion_and_wrap_around();
+
+    if (failures) {
+        cerr << failures << " checks failed" << endl;
+        return 1;
+    }
+    cout << "All flow id allocator tests passed" << endl;
+    return 0;
+}
@@ -0,0 +1,104 @@
+/*
+ * Copyright (C) 2013 by Tim Diels
+ *
+ * This file is part of pwnat.
+ *
+ * pwnat is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * pwnat is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with pwnat.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <thread>
+#include <vector>
+#include <boost/asio.hpp>
+#include <pwnat/ReceiveBatch.h>
+
+using namespace std;
+namespace asio = boost::asio;
+
+const size_t packet_size = 84;  // size of an ICMP ttl exceeded, including IPv4 header
+const size_t slot_size = 1500;  // ProxyServer::receive_slot_size
+const size_t sender_count = 2;
+const chrono::seconds duration(2);
+
+/**
+ * Floods a loopback UDP socket and receives with the loop of
+ * ProxyServer::handle_receive: wait for readability, receive one batch, repeat
+ *
+ * A batch size of 1 receives one packet per wakeup, like before recvmmsg.
+ */
+static void run(size_t batch_size) {
+    asio::io_service io_service;
+    asio::ip::udp::socket socket(io_service, asio::ip::udp::endpoint(asio::ip::address_v4::loopback(), 0));
+    socket.set_option(asio::socket_base::receive_buffer_size(8 * 1024 * 1024));
+    socket.non_blocking(true);
+    auto endpoint = socket.local_endpoint();
+
+    ReceiveBatch batch(batch_size, slot_size);
+    size_t received = 0;
+    size_t wakeups = 0;
+    atomic<bool> stop(false);
+
+    std::function<void(const boost::system::error_code&)> handle_receive = [&](const boost::system::error_code& error) {
+        if (error || stop) return;
+        wakeups++;
+        int count = batch.receive(socket.native_handle());
+        if (count > 0) {
+            received += count;
+        }
+        else if (count < 0 && errno != EAGAIN && errno != EWOULDBLOCK) {
+            cerr << "receive failed: " << strerror(errno) << endl;
+            return;
+        }
+        socket.async_wait(asio::ip::udp::socket::wait_read, handle_receive);
+    };
+
+    vector<thread> senders;
+    for (size_t i = 0; i < sender_count; i++) {
+        senders.emplace_back([&]() {
+            asio::io_service sender_service;
+            asio::ip::udp::socket sender(sender_service, asio::ip::udp::v4());
+            sender.connect(endpoint);
+            vector<char> packet(packet_size, 'x');
+            boost::system::error_code error;
+            while (!stop) {
+                sender.send(asio::buffer(packet), 0, error);
+            }
+        });
+    }
+
+    socket.async_wait(asio::ip::udp::socket::wait_read, handle_receive);
+    auto start = chrono::steady_clock::now();
+    while (chrono::steady_clock::now() - start < duration) {
+        io_service.run_one();
+    }
+    chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+    stop = true;
+    for (auto& sender : senders) {
+        sender.join();
+    }
+
+    cout << batch_size << "\t" << received / elapsed.count() << "\t" << static_cast<double>(received) / wakeups << endl;
+}
+
+int main() {
+    cout << "batch size\tpackets/s\tpackets/wakeup" << endl;
+    for (size_t batch_size : {1, 8, 64}) {
+        run(batch_size);
+    }
+    return 0;
+}
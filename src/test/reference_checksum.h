@@ -0,0 +1,41 @@
+/*
+ * Copyright (C) 2013 by Tim Diels
+ *
+ * This file is part of pwnat.
+ *
+ * pwnat is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * pwnat is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with pwnat.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * Byte-wise internet checksum (RFC 1071), as reference for the optimized get_checksum
+ *
+ * Returns the checksum in network byte order, i.e. as htons(get_checksum(...)).
+ */
+inline uint16_t get_reference_checksum(const unsigned char* data, size_t bytes) {
+    uint32_t sum = 0;
+    for (size_t i = 0; i + 1 < bytes; i += 2) {
+        sum += (data[i] << 8) | data[i + 1];
+        sum = (sum & 0xFFFF) + (sum >> 16);
+    }
+    if (bytes % 2) {
+        sum += data[bytes - 1] << 8;
+        sum = (sum & 0xFFFF) + (sum >> 16);
+    }
+    return static_cast<uint16_t>(~sum);
+}
@@ -0,0 +1,141 @@
+/*
+ * Copyright (C) 2013 by Tim Diels
+ *
+ * This file is part of pwnat.
+ *
+ * pwnat is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * pwnat is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with pwnat.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <vector>
+#include <pwnat/ChunkBuffer.h>
+#include <pwnat/metrics/Counter.h>
+
+using namespace std;
+namespace asio = boost::asio;
+typedef chrono::steady_clock Clock;
+
+const size_t message_count = 2000000;
+const size_t round_count = 5;
+
+static Counter bytes_received("bench_bytes_received_total", "Bytes received");
+static Counter bytes_sent("bench_bytes_sent_total", "Bytes sent");
+static Counter send_buffer_bytes("bench_send_buffer_bytes", "Bytes in send buffers", Counter::GAUGE);
+static Counter receive_buffer_bytes("bench_receive_buffer_bytes", "Bytes in receive buffers", Counter::GAUGE);
+
+/**
+ * Stand-in for the buffers of an AbstractSocket, with its per socket and
+ * process wide buffer metrics
+ */
+class Socket {
+public:
+    Socket() :
+        m_reported_send_buffer_size(0),
+        m_reported_receive_buffer_size(0),
+        m_bytes_sent(0),
+        m_bytes_received(0)
+    {
+    }
+
+    // like AbstractSocket::update_buffer_metrics
+    void update_buffer_metrics() {
+        // Note: usually only one of the buffers changed, skip the other
+        size_t send_size = m_send_buffer.size();
+        size_t reported_send_size = m_reported_send_buffer_size.load(memory_order_relaxed);
+        if (send_size != reported_send_size) {
+            send_buffer_bytes.add(static_cast<int64_t>(send_size) - static_cast<int64_t>(reported_send_size));
+            m_reported_send_buffer_size.store(send_size, memory_order_relaxed);
+        }
+
+        size_t receive_size = m_receive_buffer.size();
+        size_t reported_receive_size = m_reported_receive_buffer_size.load(memory_order_relaxed);
+        if (receive_size != reported_receive_size) {
+            receive_buffer_bytes.add(static_cast<int64_t>(receive_size) - static_cast<int64_t>(reported_receive_size));
+            m_reported_receive_buffer_size.store(receive_size, memory_order_relaxed);
+        }
+    }
+
+public:
+    ChunkBuffer m_receive_buffer;
+    ChunkBuffer m_send_buffer;
+    atomic<size_t> m_reported_send_buffer_size;
+    atomic<size_t> m_reported_receive_buffer_size;
+    atomic<u_int64_t> m_bytes_sent;
+    atomic<u_int64_t> m_bytes_received;
+};
+
+/**
+ * Relay messages from one socket to the other the way UDTSocket and Socket
+ * do: receive into the receive buffer, hand the chunks to the other's send
+ * buffer, send them. With metrics, count the bytes where they cross the wire
+ * and update the buffer metrics wherever a buffer changed.
+ *
+ * Returns nanoseconds per message.
+ */
+template <bool with_metrics>
+static double relay(size_t message_size) {
+    Socket from;
+    Socket to;
+
+    auto start = Clock::now();
+    for (size_t i = 0; i < message_count; i++) {
+        auto buffer = from.m_receive_buffer.prepare(message_size);
+        size_t received = asio::buffer_size(buffer);
+        memset(asio::buffer_cast<char*>(buffer), 'x', received);
+        from.m_receive_buffer.commit(received);
+        if (with_metrics) {
+            bytes_received.add(received);
+            from.m_bytes_received.store(from.m_bytes_received.load(memory_order_relaxed) + received, memory_order_relaxed);
+            from.update_buffer_metrics();
+        }
+
+        to.m_send_buffer.append(from.m_receive_buffer);
+        if (with_metrics) {
+            to.update_buffer_metrics();
+            from.update_buffer_metrics();
+        }
+
+        size_t size = to.m_send_buffer.size();
+        to.m_send_buffer.consume(size);
+        if (with_metrics) {
+            bytes_sent.add(size);
+            to.m_bytes_sent.store(to.m_bytes_sent.load(memory_order_relaxed) + size, memory_order_relaxed);
+            to.update_buffer_metrics();
+        }
+    }
+    chrono::duration<double, nano> elapsed = Clock::now() - start;
+    return elapsed.count() / message_count;
+}
+
+int main() {
+    cout << "message size\tmetrics\tmin ns/message\tmedian ns/message" << endl;
+    for (size_t message_size : {64, 1456, 16384}) {
+        // alternate the runs, so both see the same noise
+        vector<double> with;
+        vector<double> without;
+        for (size_t round = 0; round < round_count; round++) {
+            without.push_back(relay<false>(message_size));
+            with.push_back(relay<true>(message_size));
+        }
+        sort(with.begin(), with.end());
+        sort(without.begin(), without.end());
+        cout << message_size << "\toff\t" << without.front() << "\t" << without.at(round_count / 2) << endl;
+        cout << message_size << "\ton\t" << with.front() << "\t" << with.at(round_count / 2) << endl;
+    }
+    return 0;
+}
@@ -0,0 +1,169 @@
+/*
+ * Copyright (C) 2013 by Tim Diels
+ *
+ * This file is part of pwnat.
+ *
+ * pwnat is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * pwnat is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with pwnat.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <vector>
+#include <boost/asio.hpp>
+#include <boost/bind.hpp>
+#include <pwnat/SendCoalescer.h>
+
+using namespace std;
+namespace asio = boost::asio;
+typedef chrono::steady_clock Clock;
+
+const size_t message_size = 64;
+const size_t packet_size = 1456;  // default --coalescebytes
+
+/**
+ * Stand-in for UDTSocket: buffers small messages and, once the coalescer says
+ * they're due, sends them as loopback UDP datagrams of at most packet_size
+ */
+class Flow {
+public:
+    Flow(asio::io_service& io_service, bool no_delay, long delay) :
+        m_strand(io_service),
+        m_coalescer(m_strand, packet_size, delay),
+        m_socket(io_service, asio::ip::udp::endpoint(asio::ip::address_v4::loopback(), 0)),
+        m_sink(io_service, asio::ip::udp::endpoint(asio::ip::address_v4::loopback(), 0)),
+        m_sending(false),
+        m_datagrams(0)
+    {
+        m_coalescer.set_no_delay(no_delay);
+        m_socket.connect(m_sink.local_endpoint());
+        m_sink.set_option(asio::socket_base::receive_buffer_size(8 * 1024 * 1024));
+    }
+
+    void write() {
+        m_buffer.insert(m_buffer.end(), message_size, 'x');
+        m_enqueued.push_back(Clock::now());
+        start_sending();
+    }
+
+    void start_sending() {
+        if (m_sending) return;
+
+        if (m_buffer.empty()) {
+            m_coalescer.reset();
+        }
+        else if (m_coalescer.due(m_buffer.size(), boost::bind(&Flow::start_sending, this))) {
+            m_sending = true;
+            m_strand.post(boost::bind(&Flow::handle_send, this));  // like waiting for UDT's send event
+        }
+    }
+
+    size_t datagrams() const {
+        return m_datagrams;
+    }
+
+    const vector<double>& latencies() const {
+        return m_latencies;
+    }
+
+private:
+    void handle_send() {
+        m_sending = false;
+        for (size_t offset = 0; offset < m_buffer.size(); offset += packet_size) {
+            size_t length = min(packet_size, m_buffer.size() - offset);
+            m_socket.send(asio::buffer(&m_buffer[offset], length));
+            m_datagrams++;
+            drain();
+        }
+
+        auto now = Clock::now();
+        for (auto enqueued : m_enqueued) {
+            m_latencies.push_back(chrono::duration<double, micro>(now - enqueued).count());
+        }
+        m_enqueued.clear();
+        m_buffer.clear();
+        start_sending();
+    }
+
+    void drain() {
+        char datagram[packet_size];
+        boost::system::error_code error;
+        m_sink.non_blocking(true);
+        while (!error) {
+            m_sink.receive(asio::buffer(datagram), 0, error);
+        }
+    }
+
+private:
+    asio::io_service::strand m_strand;
+    SendCoalescer m_coalescer;
+    asio::ip::udp::socket m_socket;
+    asio::ip::udp::socket m_sink;
+    bool m_sending;
+    vector<char> m_buffer;
+    vector<Clock::time_point> m_enqueued;
+    size_t m_datagrams;
+    vector<double> m_latencies;
+};
+
+/**
+ * Write count messages, back to back if interval is 0, else one per interval
+ */
+static void run(const char* name, bool no_delay, long delay, size_t count, long interval) {
+    asio::io_service io_service;
+    Flow flow(io_service, no_delay, delay);
+    asio::deadline_timer timer(io_service);
+    size_t written = 0;
+
+    std::function<void()> write_next = [&]() {
+        flow.write();
+        if (++written == count) return;
+        if (interval == 0) {
+            io_service.post(write_next);
+        }
+        else {
+            timer.expires_from_now(boost::posix_time::microseconds(interval));
+            timer.async_wait([&](const boost::system::error_code&) { write_next(); });
+        }
+    };
+
+    auto start = Clock::now();
+    io_service.post(write_next);
+    io_service.run();
+    chrono::duration<double> elapsed = Clock::now() - start;
+
+    vector<double> latencies = flow.latencies();
+    sort(latencies.begin(), latencies.end());
+    double mean = 0;
+    for (auto latency : latencies) {
+        mean += latency / latencies.size();
+    }
+
+    cout << name << "\t" << (interval == 0 ? "back to back" : "paced") << "\t"
+         << static_cast<double>(flow.datagrams()) / count << "\t"
+         << count / elapsed.count() << "\t"
+         << mean << "\t" << latencies[latencies.size() * 99 / 100] << endl;
+}
+
+int main() {
+    const long delay = 200;  // microseconds
+
+    cout << "setting\tworkload\tdatagrams/message\tmessages/s\tmean latency us\tp99 latency us" << endl;
+    for (long interval : {0L, 50L}) {
+        size_t count = interval == 0 ? 200000 : 20000;
+        run("nodelay", true, delay, count, interval);
+        run("coalesce", false, delay, count, interval);
+    }
+    return 0;
+}
@@ -0,0 +1,205 @@
+/*
+ * Copyright (C) 2013 by Tim Diels
+ *
+ * This file is part of pwnat.
+ *
+ * pwnat is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * pwnat is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with pwnat.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+#include <pwnat/AbstractSocket.h>
+#include <pwnat/Application.h>
+#include <boost/log/core.hpp>
+#include <boost/log/expressions.hpp>
+#include <boost/log/trivial.hpp>
+
+using namespace std;
+namespace asio = boost::asio;
+typedef chrono::steady_clock Clock;
+
+const size_t concurrent_connections = 64;
+const size_t failure_count = 200000;
+
+// Note: stand-ins for what AbstractSocket uses for flow control, which the benchmark never reaches as it sends nothing
+Application& Application::instance() {
+    abort();
+}
+
+const ProgramArgs& Application::args() {
+    abort();
+}
+
+size_t ProgramArgs::send_buffer_high_watermark() const {
+    abort();
+}
+
+size_t ProgramArgs::send_buffer_low_watermark() const {
+    abort();
+}
+
+/**
+ * Socket that fails on its first receive, torn down by AbstractSocket::die
+ */
+class FailingSocket : public AbstractSocket {
+public:
+    FailingSocket(asio::io_service::strand strand, DeathHandler death_handler) :
+        AbstractSocket(true, strand, death_handler, "Failing socket")
+    {
+    }
+
+    void connect(u_int16_t, asio::ip::address, u_int16_t) {
+    }
+
+    void receive_data_from(AbstractSocket&) {
+    }
+
+    void handle_receive() {
+        die("Error while receiving");
+    }
+
+protected:
+    void start_receiving() {
+    }
+
+    void start_sending() {
+    }
+};
+
+/**
+ * Stand-in for a socket as they used to fail: call the death handler and
+ * throw through io_service::run
+ */
+class ThrowingSocket {
+public:
+    ThrowingSocket(asio::io_service::strand, function<void()> death_handler) :
+        m_death_handler(death_handler),
+        m_disposed(false)
+    {
+    }
+
+    void handle_receive() {
+        if (m_disposed) return;
+
+        auto death_handler = m_death_handler;
+        m_disposed = true;
+        death_handler();
+        throw runtime_error("socket died: Error while receiving");
+    }
+
+private:
+    function<void()> m_death_handler;
+    bool m_disposed;
+};
+
+/**
+ * Stand-in for a ProxyClient whose socket fails on its first receive
+ *
+ * Deletes itself when its socket dies, and starts a replacement until the
+ * benchmark has seen enough failures, as a server under connection churn does.
+ */
+template <typename SocketType>
+class Connection {
+public:
+    Connection(asio::io_service& io_service, atomic<size_t>& failures) :
+        m_io_service(io_service),
+        m_strand(io_service),
+        m_socket(m_strand, bind(&Connection::die, this)),
+        m_failures(failures)
+    {
+        m_strand.post(bind(&Connection::handle_receive, this));
+    }
+
+private:
+    void handle_receive() {
+        m_socket.handle_receive();
+    }
+
+    void die() {
+        if (++m_failures < failure_count) {
+            new Connection(m_io_service, m_failures);
+        }
+        delete this;
+    }
+
+private:
+    asio::io_service& m_io_service;
+    asio::io_service::strand m_strand;
+    SocketType m_socket;
+    atomic<size_t>& m_failures;
+};
+
+/**
+ * Run the io_service like Application::run_io_service, restarting run after
+ * each exception if throwing
+ */
+static void run_io_service(asio::io_service& io_service, bool throwing) {
+    if (throwing) {
+        while (!io_service.stopped()) {
+            try {
+                io_service.run();
+            }
+            catch (const runtime_error&) {
+            }
+        }
+    }
+    else {
+        io_service.run();
+    }
+}
+
+template <typename SocketType>
+static void run(const char* name, bool throwing, size_t thread_count) {
+    asio::io_service io_service;
+    atomic<size_t> failures(0);
+    for (size_t i = 0; i < concurrent_connections; i++) {
+        new Connection<SocketType>(io_service, failures);
+    }
+
+    auto start = Clock::now();
+    vector<thread> threads;
+    for (size_t i = 0; i < thread_count; i++) {
+        threads.emplace_back([&]() { run_io_service(io_service, throwing); });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    chrono::duration<double> elapsed = Clock::now() - start;
+
+    cout << name << "\t" << thread_count << "\t" << failures / elapsed.count() << endl;
+}
+
+int main() {
+    vector<size_t> thread_counts(1, 1);
+    if (thread::hardware_concurrency() > 1) {
+        thread_counts.push_back(thread::hardware_concurrency());
+    }
+
+    // Note: die logs each death as an error, only measure the filtering of that
+    boost::log::core::get()->set_filter(boost::log::trivial::severity >= boost::log::trivial::fatal);
+
+    cout << "teardown\tio threads\tfailures/s" << endl;
+    for (auto thread_count : thread_counts) {
+        run<ThrowingSocket>("throw", true, thread_count);
+        run<FailingSocket>("deferred", false, thread_count);
+    }
+    return 0;
+}
@@ -0,0 +1,230 @@
+/*
+ * Copyright (C) 2013 by Tim Diels
+ *
+ * This file is part of pwnat.
+ *
+ * pwnat is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * pwnat is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with pwnat.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <thread>
+#include <vector>
+#include <arpa/inet.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <pwnat/udtservice/UDTServicePool.h>
+#include <boost/log/core.hpp>
+#include <boost/log/expressions.hpp>
+#include <boost/log/trivial.hpp>
+
+using namespace std;
+namespace asio = boost::asio;
+
+const size_t flow_count = 32;
+const size_t packet_size = 1456;
+const size_t wakeup_budget = 64 * 1024;  // bytes received per event, like UDTSocket::wakeup_budget
+const size_t sender_count = 2;
+const chrono::seconds duration(2);
+
+static const int EASYNCSND = 6001; // no room in UDT's send buffer
+
+// Note: stand-in for the one in util.cpp, which drags in the sockets
+string format_udt_error(string prefix) {
+    return prefix + ": " + UDT::getlasterror().getErrorMessage();
+}
+
+static void check_udt(int result, const string& what) {
+    if (result == UDT::ERROR) {
+        cerr << format_udt_error(what) << endl;
+        abort();
+    }
+}
+
+/**
+ * Connect a pair of UDT sockets over loopback, in rendezvous mode like UDTSocket
+ */
+static pair<UDTSOCKET, UDTSOCKET> connect_pair() {
+    UDTSOCKET sockets[2];
+    sockaddr_in addresses[2];
+    for (int i = 0; i < 2; i++) {
+        sockets[i] = UDT::socket(AF_INET, SOCK_STREAM, 0);
+        if (sockets[i] == UDT::INVALID_SOCK) {
+            check_udt(UDT::ERROR, "Could not create UDTSOCKET");
+        }
+        bool rendezvous = true;
+        UDT::setsockopt(sockets[i], 0, UDT_RENDEZVOUS, &rendezvous, sizeof(bool));
+
+        sockaddr_in& address = addresses[i];
+        address = sockaddr_in();
+        address.sin_family = AF_INET;
+        address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        check_udt(UDT::bind(sockets[i], reinterpret_cast<sockaddr*>(&address), sizeof(address)), "Could not bind");
+        int size = sizeof(address);
+        check_udt(UDT::getsockname(sockets[i], reinterpret_cast<sockaddr*>(&address), &size), "Could not get bound address");
+    }
+
+    // Note: a rendezvous connect blocks until the other side connects as well
+    thread other([&]() {
+        check_udt(UDT::connect(sockets[1], reinterpret_cast<sockaddr*>(&addresses[0]), sizeof(sockaddr_in)), "Could not connect");
+    });
+    check_udt(UDT::connect(sockets[0], reinterpret_cast<sockaddr*>(&addresses[1]), sizeof(sockaddr_in)), "Could not connect");
+    other.join();
+
+    for (auto socket : sockets) {
+        bool non_blocking_mode = false;
+        UDT::setsockopt(socket, 0, UDT_SNDSYN, &non_blocking_mode, sizeof(bool));
+        UDT::setsockopt(socket, 0, UDT_RCVSYN, &non_blocking_mode, sizeof(bool));
+    }
+    return make_pair(sockets[0], sockets[1]);
+}
+
+/**
+ * Stand-in for the receiving side of a UDTSocket: drains its socket on each
+ * receive event from the service the pool places it on, in its own strand
+ */
+class Flow {
+public:
+    Flow(asio::io_service& io_service, UDTServicePool& udt_services, UDTSOCKET socket, atomic<size_t>& received) :
+        m_strand(io_service),
+        m_socket(socket),
+        m_udt_service(udt_services.get(socket)),
+        m_received(received)
+    {
+    }
+
+    void start() {
+        m_udt_service.request_receive(m_socket, m_strand.wrap(bind(&Flow::handle_receive, this)));
+    }
+
+    UDTService& udt_service() {
+        return m_udt_service;
+    }
+
+private:
+    void handle_receive() {
+        char buffer[wakeup_budget];
+        size_t received = 0;
+        while (received < wakeup_budget) {
+            int size = UDT::recv(m_socket, buffer, sizeof(buffer), 0);
+            if (size == UDT::ERROR) break;
+            received += size;
+        }
+        m_received += received;
+        start();
+    }
+
+private:
+    asio::io_service::strand m_strand;
+    UDTSOCKET m_socket;
+    UDTService& m_udt_service;
+    atomic<size_t>& m_received;
+};
+
+/**
+ * Send over flow_count UDT connections, receiving through a UDTServicePool of service_count services
+ *
+ * Prints a row of the results.
+ */
+static void run(size_t service_count, size_t io_thread_count) {
+    asio::io_service io_service;
+    asio::io_service::work work(io_service);
+    UDTServicePool udt_services(io_service, service_count, 0);
+
+    atomic<size_t> received(0);
+    vector<UDTSOCKET> senders;
+    vector<unique_ptr<Flow>> flows;
+    map<UDTService*, size_t> flows_per_service;
+    for (size_t i = 0; i < flow_count; i++) {
+        auto sockets = connect_pair();
+        senders.push_back(sockets.first);
+        flows.push_back(unique_ptr<Flow>(new Flow(io_service, udt_services, sockets.second, received)));
+        flows_per_service[&flows.back()->udt_service()]++;
+        flows.back()->start();
+    }
+    size_t max_flows_per_service = 0;
+    for (auto& entry : flows_per_service) {
+        max_flows_per_service = max(max_flows_per_service, entry.second);
+    }
+
+    vector<thread> io_threads;
+    for (size_t i = 0; i < io_thread_count; i++) {
+        io_threads.emplace_back([&]() { io_service.run(); });
+    }
+
+    atomic<bool> stop(false);
+    vector<thread> sender_threads;
+    for (size_t i = 0; i < sender_count; i++) {
+        sender_threads.emplace_back([&, i]() {
+            vector<char> packet(packet_size, 'x');
+            for (size_t flow = i; !stop; flow = (flow + sender_count) % flow_count) {
+                if (UDT::send(senders.at(flow), packet.data(), packet.size(), 0) == UDT::ERROR && UDT::getlasterror().getErrorCode() != EASYNCSND) {
+                    check_udt(UDT::ERROR, "Failed to send");
+                }
+            }
+        });
+    }
+
+    this_thread::sleep_for(chrono::milliseconds(500));  // warm up, UDT's congestion control ramps up
+    size_t start_received = received;
+    auto start = chrono::steady_clock::now();
+    this_thread::sleep_for(duration);
+    size_t end_received = received;
+    chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+
+    stop = true;
+    for (auto& sender_thread : sender_threads) {
+        sender_thread.join();
+    }
+    io_service.stop();
+    for (auto& io_thread : io_threads) {
+        io_thread.join();
+    }
+
+    cout << service_count << "\t" << io_thread_count << "\t" << max_flows_per_service << "\t" << (end_received - start_received) / elapsed.count() / 1e6 << endl;
+}
+
+int main() {
+    size_t io_thread_count = max(1u, thread::hardware_concurrency());
+    vector<size_t> service_counts = {1, 2, 4};
+    if (thread::hardware_concurrency() > 4) {
+        service_counts.push_back(thread::hardware_concurrency());
+    }
+
+    cout << "services\tio threads\tmax flows per service\tMB/s" << endl;
+    for (auto service_count : service_counts) {
+        // Note: a stopped UDTService aborts, so each run gets a process of its own, which exits without stopping them
+        pid_t child = fork();
+        if (child == 0) {
+            boost::log::core::get()->set_filter(boost::log::trivial::severity >= boost::log::trivial::warning);
+            UDT::startup();
+            run(service_count, io_thread_count);
+            cout.flush();
+            _exit(0);
+        }
+        int status;
+        waitpid(child, &status, 0);
+        if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+            cerr << "Run with " << service_count << " services failed" << endl;
+            return 1;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,149 @@
+/*
+ * Copyright (C) 2013 by Tim Diels
+ *
+ * This file is part of pwnat.
+ *
+ * pwnat is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * pwnat is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with pwnat.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <iostream>
+#include <mutex>
+#include <random>
+#include <thread>
+#include <vector>
+#include <pwnat/udtservice/UDTEventPoller.h>
+
+using namespace std;
+typedef chrono::steady_clock Clock;
+
+const size_t request_count = 50;
+
+// Note: stand-in for the one in util.cpp, which drags in the sockets
+string format_udt_error(string prefix) {
+    return prefix + ": " + UDT::getlasterror().getErrorMessage();
+}
+
+/**
+ * Stand-in for UDTService: its loop around the poller, with a request queue
+ * like UDTDispatcher's
+ *
+ * wake: whether requests wake the poller, else they're only seen once the
+ * poller times out, as before the poller had a wakeup pipe
+ * all_handling: wait like UDTService does while all sockets with events are
+ * still handling a previous one
+ */
+class Service {
+public:
+    Service(bool wake, bool all_handling) :
+        m_wake(wake),
+        m_all_handling(all_handling),
+        m_stopped(false),
+        m_thread(&Service::run, this)
+    {
+    }
+
+    ~Service() {
+        m_stopped = true;
+        m_poller.wake();
+        m_thread.join();
+    }
+
+    /**
+     * Queue a request and block until the service thread processed it
+     */
+    void request() {
+        unique_lock<mutex> lock(m_lock);
+        m_requests.push_back(Clock::now());
+        if (m_wake) {
+            m_poller.wake();
+        }
+        m_processed.wait(lock, [this]() { return m_requests.empty(); });
+    }
+
+    const vector<double>& latencies() const {
+        return m_latencies;
+    }
+
+private:
+    void run() {
+        set<UDTSOCKET> receive_events;
+        set<UDTSOCKET> send_events;
+        while (!m_stopped) {
+            if (m_all_handling) {
+                m_poller.wait_for_wake();
+            }
+            else {
+                m_poller.wait(receive_events, send_events);
+            }
+            process_requests();
+        }
+    }
+
+    void process_requests() {
+        lock_guard<mutex> lock(m_lock);
+        auto now = Clock::now();
+        for (auto queued : m_requests) {
+            m_latencies.push_back(chrono::duration<double, micro>(now - queued).count());
+        }
+        m_requests.clear();
+        m_processed.notify_all();
+    }
+
+private:
+    UDTEventPoller m_poller;
+    const bool m_wake;
+    const bool m_all_handling;
+    volatile bool m_stopped;
+
+    mutex m_lock; // guards the members below
+    condition_variable m_processed;
+    vector<Clock::time_point> m_requests;
+    vector<double> m_latencies;
+
+    thread m_thread; // Note: last, it uses the members above
+};
+
+static void run(const char* name, bool wake, bool all_handling) {
+    vector<double> latencies;
+    {
+        Service service(wake, all_handling);
+        mt19937 random(42);
+        uniform_int_distribution<int> pause(0, 100000);  // us, up to the poll timeout, so requests land at any point of it
+        for (size_t i = 0; i < request_count; i++) {
+            this_thread::sleep_for(chrono::microseconds(pause(random)));
+            service.request();
+        }
+        latencies = service.latencies();
+    }
+
+    sort(latencies.begin(), latencies.end());
+    double mean = 0;
+    for (auto latency : latencies) {
+        mean += latency / latencies.size();
+    }
+    cout << name << "\t" << mean << "\t" << latencies.at(latencies.size() / 2) << "\t" << latencies.at(latencies.size() * 99 / 100) << endl;
+}
+
+int main() {
+    UDT::startup();
+    cout << "mode\tmean latency us\tp50 latency us\tp99 latency us" << endl;
+    run("timeout", false, false);
+    run("wake", true, false);
+    run("wait_for_wake", true, true);
+    UDT::cleanup();
+    return 0;
+}